@@ -14,6 +14,8 @@
 #include <osgDB/WriteFile>
 #include <osgUtil/Optimizer>
 #include <osgUtil/MeshOptimizers>
+#include <osgUtil/UpdateVisitor>
+#include <osgAnimation/BasicAnimationManager>
 
 #include <vsg/core/Objects.h>
 #include <osg2vsg/ShaderUtils.h>
@@ -21,8 +23,34 @@
 #include <osg2vsg/SceneBuilder.h>
 #include <osg2vsg/SceneAnalysis.h>
 #include <osg2vsg/Optimize.h>
+#include <osg2vsg/MeshOptimizer.h>
+#include <osg2vsg/MeshCodec.h>
 
 
+namespace osg2vsg
+{
+    // start all the animations of the osgAnimation managers in the scene graph, which the osg update traversal then advances
+    class PlayAnimations : public osg::NodeVisitor
+    {
+    public:
+        PlayAnimations() :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+        void apply(osg::Node& node) override
+        {
+            for (osg::Callback* callback = node.getUpdateCallback(); callback; callback = callback->getNestedCallback())
+            {
+                if (auto manager = dynamic_cast<osgAnimation::BasicAnimationManager*>(callback))
+                {
+                    for (auto& animation : manager->getAnimationList()) manager->playAnimation(animation.get());
+                }
+            }
+
+            traverse(node);
+        }
+    };
+}
+
 namespace vsg
 {
     class AnimationPathHandler : public Inherit<Visitor, AnimationPathHandler>
@@ -234,10 +262,40 @@ int main(int argc, char** argv)
     if (arguments.read("--Geometry")) { buildOptions->geometryTarget = osg2vsg::VSG_GEOMETRY; }
     if (arguments.read("--VertexIndexDraw")) { buildOptions->geometryTarget = osg2vsg::VSG_VERTEXINDEXDRAW; }
     if (arguments.read("--Commands")) { buildOptions->geometryTarget = osg2vsg::VSG_COMMANDS; }
+    if (arguments.read("--auto-target")) { buildOptions->geometryTarget = osg2vsg::VSG_AUTO; }
+    if (arguments.read("--split-large-meshes")) { buildOptions->geometryOptions.splitLargeMeshes = true; }
+    if (arguments.read("--interleave")) { buildOptions->interleaveVertexArrays = true; }
+    if (arguments.read("--quantize")) { buildOptions->quantizeVertexAttributes = true; }
+    if (arguments.read("--batch-geometries")) { buildOptions->batchGeometries = true; }
+    if (arguments.read("--batch-cell-size", buildOptions->batchCellSize)) { buildOptions->batchGeometries = true; }
+    if (arguments.read("--batch-max-vertices", buildOptions->batchMaxVertices)) { buildOptions->batchGeometries = true; }
+    if (arguments.read("--arenas")) { buildOptions->packArenas = true; }
+    if (arguments.read("--indirect")) { buildOptions->packArenas = true; buildOptions->indirectDraws = true; }
+    if (arguments.read("--multi-draw-indirect")) { buildOptions->packArenas = true; buildOptions->indirectDraws = true; buildOptions->multiDrawIndirect = true; }
+    if (arguments.read("--conversion-threads", buildOptions->numThreads)) {}
+    if (arguments.read("--clusters")) { buildOptions->generateClusters = true; }
+    if (arguments.read("--cluster-max-vertices", buildOptions->geometryOptions.maxClusterVertices)) { buildOptions->generateClusters = true; }
+    if (arguments.read("--cluster-max-triangles", buildOptions->geometryOptions.maxClusterTriangles)) { buildOptions->generateClusters = true; }
+    if (arguments.read("--lods")) { buildOptions->generateLODs = true; }
+    if (arguments.read("--tight-bounds")) { buildOptions->tightBounds = true; }
+    if (arguments.read("--instance")) { buildOptions->instanceGeometries = true; }
+    if (arguments.read("--min-instances", buildOptions->minInstances)) { buildOptions->instanceGeometries = true; }
+    if (arguments.read("--lod-min-triangles", buildOptions->geometryOptions.lodMinTriangles)) { buildOptions->generateLODs = true; }
+    if (arguments.read("--lod-levels", buildOptions->geometryOptions.numLODLevels)) { buildOptions->generateLODs = true; }
+    if (arguments.read("--lod-pixel-error", buildOptions->geometryOptions.lodPixelError)) { buildOptions->generateLODs = true; }
+    if (arguments.read("--no-array-cache")) { buildOptions->geometryOptions.arrayCache = nullptr; }
+    if (arguments.read("--relative-to-center")) { buildOptions->geometryOptions.relativeToCenter = true; }
+    if (arguments.read("--keep-unused-attributes")) { buildOptions->stripUnusedAttributes = false; }
+    if (arguments.read("--weld")) { buildOptions->geometryOptions.weldVertices = true; }
+    if (arguments.read("--reduce-overdraw")) { buildOptions->reduceOverdraw = true; }
+    if (arguments.read("--weld-tolerance", buildOptions->geometryOptions.weldTolerance)) { buildOptions->geometryOptions.weldVertices = true; }
+    if (arguments.read("--encode-meshes")) { buildOptions->encodeMeshes = true; }
+    if (arguments.read("--encode-bits", buildOptions->encodeQuantizationBits)) { buildOptions->encodeMeshes = true; }
     if (arguments.read({"--bind-single-ds", "--bsds"})) buildOptions->useBindDescriptorSet = true;
     auto numFrames = arguments.value(-1, "-f");
     auto writeToFileProgramAndDataSetSets = arguments.read({"--write-stateset", "--ws"});
     auto optimize = !arguments.read("--no-optimize");
+    buildOptions->optimizeMeshes = optimize;
     auto outputFilename = arguments.value(std::string(), "-o");
     auto printStats = arguments.read({"-s", "--stats"});
     auto pathFilename = arguments.value(std::string(),"-p");
@@ -274,6 +332,10 @@ int main(int argc, char** argv)
 
         if (loaded_scene)
         {
+            // expand any meshes written with --encode-meshes
+            osg2vsg::DecodeMeshes decodeMeshes;
+            loaded_scene->accept(decodeMeshes);
+
             std::cout<<"VSG loadTime = "<<vsg_loadTime<<"ms"<<std::endl;
 
             vsgNodes.push_back(loaded_scene);
@@ -310,14 +372,6 @@ int main(int argc, char** argv)
             osg_scene->accept(imv);
             imv.makeMesh();
 
-            osgUtil::VertexCacheVisitor vcv;
-            osg_scene->accept(vcv);
-            vcv.optimizeVertices();
-
-            osgUtil::VertexAccessOrderVisitor vaov;
-            osg_scene->accept(vaov);
-            vaov.optimizeOrder();
-
             osgUtil::Optimizer optimizer;
             optimizer.optimize(osg_scene.get(), osgUtil::Optimizer::DEFAULT_OPTIMIZATIONS);
 
@@ -341,6 +395,18 @@ int main(int argc, char** argv)
         // build VSG scene
         vsg::ref_ptr<vsg::Node> converted_vsg_scene = sceneBuilder.createVSG(searchPaths);
 
+        if (printStats && buildOptions->geometryOptions.stats) buildOptions->geometryOptions.stats->print(std::cout);
+
+        if (converted_vsg_scene && optimize)
+        {
+            // vertex cache and vertex fetch optimization of the converted meshes
+            osg2vsg::OptimizeMeshes optimizeMeshes;
+            optimizeMeshes.reduceOverdraw = buildOptions->reduceOverdraw;
+            converted_vsg_scene->accept(optimizeMeshes);
+            optimizeMeshes.optimize();
+            if (printStats) optimizeMeshes.print(std::cout);
+        }
+
         if (converted_vsg_scene)
         {
             vsgNodes.push_back(converted_vsg_scene);
@@ -381,6 +447,13 @@ int main(int argc, char** argv)
         }
         else if (vsg_scene.valid())
         {
+            if (buildOptions->encodeMeshes)
+            {
+                osg2vsg::EncodeMeshes encodeMeshes(buildOptions->encodeQuantizationBits);
+                vsg_scene->accept(encodeMeshes);
+                if (printStats) encodeMeshes.print(std::cout);
+            }
+
             if (batchLeafData)
             {
                 osg2vsg::LeafDataCollection leafDataCollection;
@@ -408,6 +481,9 @@ int main(int argc, char** argv)
         vsgSceneAnalysis._sceneStats->print(std::cout);
     }
 
+    // the DrawIndexedIndirect commands issue all their draws with one call when written with --multi-draw-indirect
+    if (buildOptions->multiDrawIndirect) windowTraits->deviceFeatures.multiDrawIndirect = VK_TRUE;
+
     // create the viewer and assign window(s) to it
     auto viewer = vsg::Viewer::create();
 
@@ -471,6 +547,19 @@ int main(int argc, char** argv)
         viewer->addEventHandler(vsg::AnimationPathHandler::create(camera, animationPath, viewer->start_point(), simulationStep));
     }
 
+    // skinned geometries are posed by the osg update traversal of the source scene graph, then their bone matrices uploaded
+    osg::ref_ptr<osgUtil::UpdateVisitor> updateVisitor;
+    osg::ref_ptr<osg::FrameStamp> osgFrameStamp;
+    if (osg_scene.valid() && !sceneBuilder.skinnedGeometries.empty())
+    {
+        osg2vsg::PlayAnimations playAnimations;
+        osg_scene->accept(playAnimations);
+
+        updateVisitor = new osgUtil::UpdateVisitor;
+        osgFrameStamp = new osg::FrameStamp;
+        updateVisitor->setFrameStamp(osgFrameStamp.get());
+    }
+
     // rendering main loop
     while (viewer->advanceToNextFrame() && (numFrames<0 || (numFrames--)>0))
     {
@@ -479,6 +568,23 @@ int main(int argc, char** argv)
 
         viewer->update();
 
+        if (updateVisitor)
+        {
+            double time = std::chrono::duration<double, std::chrono::seconds::period>(vsg::clock::now() - viewer->start_point()).count();
+            osgFrameStamp->setFrameNumber(osgFrameStamp->getFrameNumber() + 1);
+            osgFrameStamp->setReferenceTime(time);
+            osgFrameStamp->setSimulationTime(time);
+            updateVisitor->setTraversalNumber(osgFrameStamp->getFrameNumber());
+            osg_scene->accept(*updateVisitor);
+
+            for (auto& [rigGeometry, skinned] : sceneBuilder.skinnedGeometries)
+            {
+                if (!skinned || !skinned->descriptorBuffer) continue;
+                skinned->update();
+                skinned->descriptorBuffer->copyDataListToBuffers();
+            }
+        }
+
         viewer->recordAndSubmit();
 
         viewer->present();
@@ -73,14 +73,6 @@ void ConvertToVsg::optimize(osg::Node* osg_scene)
     osg_scene->accept(imv);
     imv.makeMesh();
 
-    osgUtil::VertexCacheVisitor vcv;
-    osg_scene->accept(vcv);
-    vcv.optimizeVertices();
-
-    osgUtil::VertexAccessOrderVisitor vaov;
-    osg_scene->accept(vaov);
-    vaov.optimizeOrder();
-
     osgUtil::Optimizer optimizer;
     optimizer.optimize(osg_scene, osgUtil::Optimizer::DEFAULT_OPTIMIZATIONS & ~osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS);
 
@@ -91,6 +83,14 @@ void ConvertToVsg::optimize(osg::Node* osg_scene)
 
 vsg::ref_ptr<vsg::Node> ConvertToVsg::convert(osg::Node* node)
 {
+    // the tile root is the outermost text scope, its text is added once the whole tile has been converted so that the atlas holds all its glyphs
+    if (!textScope)
+    {
+        auto vsg_node = convertTextScope(node);
+        addTextGeometries();
+        return root = vsg_node;
+    }
+
     root = nullptr;
 
     if (auto itr = nodeMap.find(node); itr != nodeMap.end())
@@ -107,64 +107,51 @@ vsg::ref_ptr<vsg::Node> ConvertToVsg::convert(osg::Node* node)
     return root;
 }
 
-vsg::ref_ptr<vsg::Data> ConvertToVsg::copy(osg::Array* src_array)
+vsg::ref_ptr<vsg::Node> ConvertToVsg::convertTextScope(osg::Node* node)
 {
-    if (!src_array) return {};
-
-    switch(src_array->getType())
-    {
-        case(osg::Array::ByteArrayType): return {};
-        case(osg::Array::ShortArrayType): return {};
-        case(osg::Array::IntArrayType): return {};
-
-        case(osg::Array::UByteArrayType): return copyArray<vsg::ubyteArray>(src_array);
-        case(osg::Array::UShortArrayType): return copyArray<vsg::ushortArray>(src_array);
-        case(osg::Array::UIntArrayType): return copyArray<vsg::uintArray>(src_array);
-
-        case(osg::Array::FloatArrayType): return copyArray<vsg::floatArray>(src_array);
-        case(osg::Array::DoubleArrayType): return copyArray<vsg::doubleArray>(src_array);
-
-        case(osg::Array::Vec2bArrayType): return {};
-        case(osg::Array::Vec3bArrayType): return {};
-        case(osg::Array::Vec4bArrayType): return {};
+    auto scope = vsg::Group::create();
 
-        case(osg::Array::Vec2sArrayType): return {};
-        case(osg::Array::Vec3sArrayType): return {};
-        case(osg::Array::Vec4sArrayType): return {};
+    auto parentScope = textScope;
+    textScope = scope;
+    auto vsg_node = convert(node);
+    textScope = parentScope;
 
-        case(osg::Array::Vec2iArrayType): return {};
-        case(osg::Array::Vec3iArrayType): return {};
-        case(osg::Array::Vec4iArrayType): return {};
+    // the scope's group is only needed to hold the text geometries that addTextGeometries() adds to it
+    if (textBatches.count(scope) == 0) return vsg_node;
 
-        case(osg::Array::Vec2ubArrayType): return copyArray<vsg::ubvec2Array>(src_array);
-        case(osg::Array::Vec3ubArrayType): return copyArray<vsg::ubvec3Array>(src_array);
-        case(osg::Array::Vec4ubArrayType): return copyArray<vsg::ubvec4Array>(src_array);
-
-        case(osg::Array::Vec2usArrayType): return copyArray<vsg::usvec2Array>(src_array);
-        case(osg::Array::Vec3usArrayType): return copyArray<vsg::usvec3Array>(src_array);
-        case(osg::Array::Vec4usArrayType): return copyArray<vsg::usvec4Array>(src_array);
-
-        case(osg::Array::Vec2uiArrayType): return copyArray<vsg::uivec2Array>(src_array);
-        case(osg::Array::Vec3uiArrayType): return copyArray<vsg::usvec3Array>(src_array);
-        case(osg::Array::Vec4uiArrayType): return copyArray<vsg::usvec4Array>(src_array);
+    if (vsg_node) scope->addChild(vsg_node);
+    return scope;
+}
 
-        case(osg::Array::Vec2ArrayType): return copyArray<vsg::vec2Array>(src_array);
-        case(osg::Array::Vec3ArrayType): return copyArray<vsg::vec3Array>(src_array);
-        case(osg::Array::Vec4ArrayType): return copyArray<vsg::vec4Array>(src_array);
+void ConvertToVsg::addTextGeometries()
+{
+    // the batches are already in the tile's coordinates, so are converted as if found under the tile root with the states they were found under
+    StateStack savedStatestack;
+    std::swap(statestack, savedStatestack);
 
-        case(osg::Array::Vec2dArrayType): return copyArray<vsg::dvec2Array>(src_array);
-        case(osg::Array::Vec3dArrayType): return copyArray<vsg::dvec2Array>(src_array);
-        case(osg::Array::Vec4dArrayType): return copyArray<vsg::dvec2Array>(src_array);
+    for (auto& [scope, batches] : textBatches)
+    {
+        for (auto& [stack, batch] : batches)
+        {
+            statestack = stack;
+            if (auto geometry = batch->createGeometry(*glyphAtlas))
+            {
+                root = nullptr;
+                apply(*geometry);
+                if (root) scope->addChild(root);
+            }
+        }
+    }
 
-        case(osg::Array::MatrixArrayType): return copyArray<vsg::mat4Array>(src_array);
-        case(osg::Array::MatrixdArrayType): return copyArray<vsg::dmat4Array>(src_array);
+    std::swap(statestack, savedStatestack);
 
-        case(osg::Array::QuatArrayType): return {};
+    textBatches.clear();
+    glyphAtlas = nullptr;
+}
 
-        case(osg::Array::UInt64ArrayType): return {};
-        case(osg::Array::Int64ArrayType): return {};
-        default: return {};
-    }
+vsg::ref_ptr<vsg::Data> ConvertToVsg::copy(osg::Array* src_array)
+{
+    return osg2vsg::copyArray(src_array);
 }
 
 uint32_t ConvertToVsg::calculateShaderModeMask()
@@ -184,6 +171,9 @@ void ConvertToVsg::apply(osg::Geometry& geometry)
 
     uint32_t geometryMask = (osg2vsg::calculateAttributesMask(&geometry) | buildOptions->overrideGeomAttributes) & buildOptions->supportedGeometryAttributes;
     uint32_t shaderModeMask = (calculateShaderModeMask() | buildOptions->overrideShaderModeMask | nodeShaderModeMasks) & buildOptions->supportedShaderModeMask;
+    if (buildOptions->stripUnusedAttributes && buildOptions->vertexShaderPath.empty() && buildOptions->fragmentShaderPath.empty()) geometryMask = osg2vsg::stripUnusedGeometryAttributes(shaderModeMask, geometryMask);
+    if (buildOptions->interleaveVertexArrays) geometryMask |= INTERLEAVED;
+    if (buildOptions->quantizeVertexAttributes) geometryMask |= QUANTIZED;
 
     // std::cout<<"Have geometry with "<<statestack.size()<<" shaderModeMask="<<shaderModeMask<<", geometryMask="<<geometryMask<<std::endl;
 
@@ -198,7 +188,10 @@ void ConvertToVsg::apply(osg::Geometry& geometry)
         }
     }
 
-    auto vsg_geometry = osg2vsg::convertToVsg(&geometry, geometryMask, buildOptions->geometryTarget);
+    vsg::ref_ptr<vsg::Node> vsg_geometry;
+    if (buildOptions->generateLODs) vsg_geometry = osg2vsg::convertToLOD(&geometry, geometryMask, buildOptions->geometryOptions);
+    if (!vsg_geometry) vsg_geometry = osg2vsg::convertToVsg(&geometry, geometryMask, buildOptions->geometryTarget, buildOptions->geometryOptions);
+    vsg_geometry = osg2vsg::createRelativeToCenterTransform(&geometry, vsg_geometry, buildOptions->geometryOptions);
 
     if (!statestack.empty())
     {
@@ -222,6 +215,25 @@ void ConvertToVsg::apply(osg::Geometry& geometry)
     root = stategroup;
 }
 
+void ConvertToVsg::apply(osg::Drawable& drawable)
+{
+    // text placed by a osg::Billboard isn't batched as the billboard's positions aren't part of the node path
+    auto text = dynamic_cast<osgText::Text*>(&drawable);
+    if (!text || (nodeShaderModeMasks & BILLBOARD))
+    {
+        osg::NodeVisitor::apply(drawable);
+        return;
+    }
+
+    // the text's own state holds osgText's shaders, the atlas provides the glyph texture and blending in their place
+    if (!glyphAtlas) glyphAtlas = osg2vsg::GlyphAtlas::create();
+
+    auto& batch = textBatches[textScope][statestack];
+    if (!batch) batch = osg2vsg::TextBatch::create();
+
+    batch->add(*text, osg::computeLocalToWorld(getNodePath()), *glyphAtlas);
+}
+
 void ConvertToVsg::apply(osg::Group& group)
 {
     if (osgTerrain::TerrainTile* tile = dynamic_cast<osgTerrain::TerrainTile*>(&group); tile)
@@ -416,24 +428,20 @@ void ConvertToVsg::apply(osg::Billboard& billboard)
 
 void ConvertToVsg::apply(osg::LOD& lod)
 {
-    auto vsg_lod = vsg::LOD::create();
-
     const osg::BoundingSphere& bs = lod.getBound();
     osg::Vec3d center = (lod.getCenterMode()==osg::LOD::USER_DEFINED_CENTER) ? lod.getCenter() : bs.center();
     double radius = (lod.getRadius()>0.0) ? lod.getRadius() : bs.radius();
 
-    vsg_lod->setBound(vsg::dsphere(center.x(), center.y(), center.z(), radius));
-
     unsigned int numChildren = std::min(lod.getNumChildren(), lod.getNumRanges());
 
     const double pixel_ratio = 1.0/1080.0;
     const double angle_ratio = 1.0/osg::DegreesToRadians(30.0); // assume a 60 fovy for reference
 
     // build a map of minimum screen ration to child
-    std::map<double, vsg::ref_ptr<vsg::Node>> ratioChildMap;
+    osg2vsg::LODChildMap ratioChildMap;
     for(unsigned int i = 0; i < numChildren; ++i)
     {
-        if (auto vsg_child = convert(lod.getChild(i)); vsg_child)
+        if (auto vsg_child = convertTextScope(lod.getChild(i)); vsg_child)
         {
             double minimumScreenHeightRatio = (lod.getRangeMode()==osg::LOD::DISTANCE_FROM_EYE_POINT) ?
                 (atan2(radius, static_cast<double>(lod.getMaxRange(i))) * angle_ratio) :
@@ -443,13 +451,7 @@ void ConvertToVsg::apply(osg::LOD& lod)
         }
     }
 
-    // add to vsg::LOD in reverse order - highest level of detail first
-    for(auto itr = ratioChildMap.rbegin(); itr != ratioChildMap.rend(); ++itr)
-    {
-        vsg_lod->addChild(vsg::LOD::LODChild{itr->first, itr->second});
-    }
-
-    root = vsg_lod;
+    root = osg2vsg::createLOD(vsg::dsphere(center.x(), center.y(), center.z(), radius), ratioChildMap);
 }
 
 void ConvertToVsg::apply(osg::PagedLOD& plod)
@@ -489,7 +491,7 @@ void ConvertToVsg::apply(osg::PagedLOD& plod)
     for(unsigned int i = 0; i < numRanges; ++i)
     {
         vsg::ref_ptr<vsg::Node> vsg_child;
-        if (i<numChildren) vsg_child = convert(plod.getChild(i));
+        if (i<numChildren) vsg_child = convertTextScope(plod.getChild(i));
 
         double minimumScreenHeightRatio = (plod.getRangeMode()==osg::LOD::DISTANCE_FROM_EYE_POINT) ?
             (atan2(radius, static_cast<double>(plod.getMaxRange(i))) * angle_ratio) :
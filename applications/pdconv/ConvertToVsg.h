@@ -11,6 +11,7 @@
 #include <osg2vsg/ShaderUtils.h>
 #include <osg2vsg/SceneBuilder.h>
 #include <osg2vsg/Optimize.h>
+#include <osg2vsg/TextUtils.h>
 
 namespace osg2vsg
 {
@@ -62,6 +63,21 @@ public:
 
     FileNameMap filenameMap;
 
+    // the osgText::Text drawables of the tile, laid out in the tile's coordinates and batched by state within the text scope they're drawn in,
+    // with the glyphs of all their fonts packed into the one atlas the tile carries. Text in subgraphs shared within the tile is only drawn
+    // where first converted.
+    using TextBatches = std::map<StateStack, vsg::ref_ptr<osg2vsg::TextBatch>>;
+    using ScopedTextBatches = std::map<vsg::ref_ptr<vsg::Group>, TextBatches>;
+    ScopedTextBatches textBatches;
+    vsg::ref_ptr<vsg::Group> textScope;
+    vsg::ref_ptr<osg2vsg::GlyphAtlas> glyphAtlas;
+
+    // convert node as a text scope, the tile root or a LOD child, so that its text is drawn, and switched, along with it
+    vsg::ref_ptr<vsg::Node> convertTextScope(osg::Node* node);
+
+    // add a geometry for each of the text batches to the scope they were found in, called by convert() once the tile has been converted
+    void addTextGeometries();
+
 
 
     vsg::ref_ptr<vsg::BindGraphicsPipeline> getOrCreateBindGraphicsPipeline(uint32_t shaderModeMask, uint32_t geometryMask);
@@ -74,16 +90,6 @@ public:
 
     vsg::ref_ptr<vsg::Node> convert(osg::Node* node);
 
-    template<class V>
-    vsg::ref_ptr<V> copyArray(const osg::Array* array)
-    {
-        vsg::ref_ptr<V> new_array = V::create( array->getNumElements() );
-
-        std::memcpy(new_array->dataPointer(), array->getDataPointer(), array->getTotalDataSize());
-
-        return new_array;
-    }
-
     vsg::ref_ptr<vsg::Data> copy(osg::Array* src_array);
 
     struct ScopedPushPop
@@ -106,6 +112,7 @@ public:
 
     uint32_t calculateShaderModeMask();
 
+    void apply(osg::Drawable& drawable);
     void apply(osg::Geometry& geometry);
     void apply(osg::Group& group);
     void apply(osg::MatrixTransform& transform);
@@ -12,6 +12,7 @@
 #include <osg2vsg/ShaderUtils.h>
 #include <osg2vsg/SceneBuilder.h>
 #include <osg2vsg/Optimize.h>
+#include <osg2vsg/MeshOptimizer.h>
 
 #include "ConvertToVsg.h"
 
@@ -37,6 +38,17 @@ int main(int argc, char** argv)
     if (arguments.read("--Geometry")) { buildOptions->geometryTarget = osg2vsg::VSG_GEOMETRY; }
     if (arguments.read("--VertexIndexDraw")) { buildOptions->geometryTarget = osg2vsg::VSG_VERTEXINDEXDRAW; }
     if (arguments.read("--Commands")) { buildOptions->geometryTarget = osg2vsg::VSG_COMMANDS; }
+    if (arguments.read("--auto-target")) { buildOptions->geometryTarget = osg2vsg::VSG_AUTO; }
+    if (arguments.read("--split-large-meshes")) { buildOptions->geometryOptions.splitLargeMeshes = true; }
+    if (arguments.read("--interleave")) { buildOptions->interleaveVertexArrays = true; }
+    if (arguments.read("--quantize")) { buildOptions->quantizeVertexAttributes = true; }
+    if (arguments.read("--lods")) { buildOptions->generateLODs = true; }
+    if (arguments.read("--lod-min-triangles", buildOptions->geometryOptions.lodMinTriangles)) { buildOptions->generateLODs = true; }
+    if (arguments.read("--relative-to-center")) { buildOptions->geometryOptions.relativeToCenter = true; }
+    if (arguments.read("--keep-unused-attributes")) { buildOptions->stripUnusedAttributes = false; }
+    if (arguments.read("--weld")) { buildOptions->geometryOptions.weldVertices = true; }
+    if (arguments.read("--reduce-overdraw")) { buildOptions->reduceOverdraw = true; }
+    if (arguments.read("--weld-tolerance", buildOptions->geometryOptions.weldTolerance)) { buildOptions->geometryOptions.weldVertices = true; }
     if (arguments.read({"--bind-single-ds", "--bsds"})) buildOptions->useBindDescriptorSet = true;
 
     if (inputFilename.empty() || outputFilename.empty())
@@ -137,6 +149,12 @@ int main(int argc, char** argv)
 
                 if (vsg_scene)
                 {
+                    // tiles are already converted in parallel by the operation threads, so optimize this tile's meshes on this thread
+                    osg2vsg::OptimizeMeshes optimizeMeshes(1);
+                    optimizeMeshes.reduceOverdraw = buildOptions->reduceOverdraw;
+                    vsg_scene->accept(optimizeMeshes);
+                    optimizeMeshes.optimize();
+
                     if (level==0 && !inheritedStateGroup)
                     {
                         inheritedStateGroup = dynamic_cast<vsg::StateGroup*>(vsg_scene.get());
@@ -233,5 +251,11 @@ int main(int argc, char** argv)
     // signal that we are finished and the thread should close
     active->active = false;
 
+    if (buildOptions->geometryOptions.stats)
+    {
+        std::cout<<std::endl;
+        buildOptions->geometryOptions.stats->print(std::cout);
+    }
+
     return 1;
 }
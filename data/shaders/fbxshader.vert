@@ -1,5 +1,5 @@
 #version 450
-#pragma import_defines ( VSG_NORMAL, VSG_TANGENT, VSG_COLOR, VSG_TEXCOORD0, VSG_LIGHTING, VSG_NORMAL_MAP, VSG_BILLBOARD, VSG_TRANSLATE )
+#pragma import_defines ( VSG_NORMAL, VSG_TANGENT, VSG_COLOR, VSG_TEXCOORD0, VSG_LIGHTING, VSG_NORMAL_MAP, VSG_BILLBOARD, VSG_TRANSLATE, VSG_OCTAHEDRAL_NORMAL, VSG_INSTANCE_MATRIX, VSG_SKINNING )
 #extension GL_ARB_separate_shader_objects : enable
 layout(push_constant) uniform PushConstants {
     mat4 projection;
@@ -8,7 +8,11 @@ layout(push_constant) uniform PushConstants {
 } pc;
 layout(location = 0) in vec3 osg_Vertex;
 #ifdef VSG_NORMAL
+#ifdef VSG_OCTAHEDRAL_NORMAL
+layout(location = 1) in vec2 osg_Normal;
+#else
 layout(location = 1) in vec3 osg_Normal;
+#endif
 layout(location = 1) out vec3 normalDir;
 #endif
 #ifdef VSG_TANGENT
@@ -29,7 +33,30 @@ layout(location = 6) out vec3 lightDir;
 #ifdef VSG_TRANSLATE
 layout(location = 7) in vec3 translate;
 #endif
+#ifdef VSG_INSTANCE_MATRIX
+layout(location = 8) in mat4 instanceMatrix;
+#endif
+#ifdef VSG_SKINNING
+// must match osg2vsg::MAX_BONES, BONE_MATRICES_SET and BONE_MATRICES_BINDING
+#define MAX_BONES 128
+layout(location = 12) in uvec4 boneIndices;
+layout(location = 13) in vec4 boneWeights;
+layout(set = 1, binding = 0) uniform BoneMatrices {
+    mat4 matrices[MAX_BONES];
+} bones;
+#endif
 
+#ifdef VSG_OCTAHEDRAL_NORMAL
+// unfold a normal packed onto the octahedron by the osg2vsg QUANTIZED conversion
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += (v.x >= 0.0) ? -t : t;
+    v.y += (v.y >= 0.0) ? -t : t;
+    return normalize(v);
+}
+#endif
 
 out gl_PerVertex{ vec4 gl_Position; };
 
@@ -37,6 +64,19 @@ void main()
 {
     mat4 modelView = pc.modelView;
 
+#ifdef VSG_SKINNING
+    // blend the bone matrices into the model matrix so the normals and tangents are skinned along with the vertex
+    mat4 skinMatrix = bones.matrices[boneIndices.x] * boneWeights.x +
+                      bones.matrices[boneIndices.y] * boneWeights.y +
+                      bones.matrices[boneIndices.z] * boneWeights.z +
+                      bones.matrices[boneIndices.w] * boneWeights.w;
+    modelView = modelView * skinMatrix;
+#endif
+
+#ifdef VSG_INSTANCE_MATRIX
+    modelView = modelView * instanceMatrix;
+#endif
+
 #ifdef VSG_TRANSLATE
     mat4 translate_mat = mat4(1.0, 0.0, 0.0, 0.0,
                               0.0, 1.0, 0.0, 0.0,
@@ -72,7 +112,12 @@ void main()
     texCoord0 = osg_MultiTexCoord0.st;
 #endif
 #ifdef VSG_NORMAL
-    vec3 n = (modelView * vec4(osg_Normal, 0.0)).xyz;
+#ifdef VSG_OCTAHEDRAL_NORMAL
+    vec3 normal = octahedralDecode(osg_Normal);
+#else
+    vec3 normal = osg_Normal;
+#endif
+    vec3 n = (modelView * vec4(normal, 0.0)).xyz;
     normalDir = n;
 #endif
 #ifdef VSG_LIGHTING
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+#include <osg/Array>
+#include <osg/observer_ptr>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace osg2vsg
+{
+    // convert to the float arrays used for vertex attributes, double arrays are narrowed to float and integer arrays
+    // are converted to float, scaled to 0..1 (or -1..1) when the osg::Array is marked as normalized.
+    // If the array has fewer than bindOverallPaddingCount values it is padded by repeating its last value.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec2Array> convertToVsg(const osg::Vec2Array* inarray, uint32_t bindOverallPaddingCount);
+
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3Array* inarray, uint32_t bindOverallPaddingCount);
+
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec4Array> convertToVsg(const osg::Vec4Array* inarray, uint32_t bindOverallPaddingCount);
+
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Data> convertToVsg(const osg::Array* inarray, uint32_t bindOverallPaddingCount);
+
+    // convert double precision vertices to float offsets from origin, subtracting before narrowing so that vertices far from the world origin
+    // keep their precision when drawn under a transform to origin
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3dArray* inarray, const vsg::dvec3& origin);
+
+    // copy an osg::Array to the vsg array with the same value type and memory layout, the 64 bit integer arrays have no vsg equivalent so return null
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Data> copyArray(const osg::Array* inarray);
+
+    // the arrays converted from osg::Array keyed by the source array, padding count and the format converted to, so that osg::Array shared
+    // between geometries convert to shared vsg::Data. Entries are dropped once their source array is deleted, and reconverted if it's modified.
+    struct ArrayCache : public vsg::Inherit<vsg::Object, ArrayCache>
+    {
+        using Key = std::tuple<const osg::Array*, uint32_t, VkFormat>;
+
+        struct Entry
+        {
+            osg::observer_ptr<osg::Array> source;
+            unsigned int modifiedCount;
+            vsg::ref_ptr<vsg::Data> data;
+        };
+
+        using ArrayMap = std::map<Key, Entry>;
+
+        std::mutex mutex;
+        ArrayMap arrayMap;
+
+        // return the cached conversion of array, or the result of convert() added to the cache. The conversion is done outside the lock so
+        // that threads converting different arrays don't wait on each other.
+        template<typename F>
+        vsg::ref_ptr<vsg::Data> getOrCreate(const osg::Array* array, uint32_t paddingCount, VkFormat format, F convert)
+        {
+            Key key(array, paddingCount, format);
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (auto itr = arrayMap.find(key); itr != arrayMap.end() && isCurrent(itr->second, array)) return itr->second.data;
+            }
+
+            vsg::ref_ptr<vsg::Data> data = convert();
+
+            std::lock_guard<std::mutex> guard(mutex);
+
+            // another thread may have converted the same array in the meantime
+            auto& entry = arrayMap[key];
+            if (isCurrent(entry, array)) return entry.data;
+
+            entry = Entry{const_cast<osg::Array*>(array), array->getModifiedCount(), data};
+
+            // mark the data as shared so that it isn't modified in place, see OptimizeMeshes
+            if (data) data->setObject("ArrayCache", vsg::ref_ptr<vsg::Object>(new vsg::Object));
+
+            if (arrayMap.size() >= _pruneSize) prune();
+
+            return data;
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            arrayMap.clear();
+        }
+
+    protected:
+        bool isCurrent(const Entry& entry, const osg::Array* array) const
+        {
+            return entry.data && entry.source.get() == array && entry.modifiedCount == array->getModifiedCount();
+        }
+
+        // remove the entries whose source arrays have been deleted, called with the mutex locked
+        void prune()
+        {
+            for(auto itr = arrayMap.begin(); itr != arrayMap.end();)
+            {
+                if (!itr->second.source.valid()) itr = arrayMap.erase(itr);
+                else ++itr;
+            }
+            _pruneSize = std::max(size_t(1024), arrayMap.size() * 2);
+        }
+
+        size_t _pruneSize = 1024;
+    };
+}
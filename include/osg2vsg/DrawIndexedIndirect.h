@@ -0,0 +1,41 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+namespace osg2vsg
+{
+    // draw a list of VkDrawIndexedIndirectCommand, held as DRAW_SIZE uint32_t per draw, from the vertex and index arenas bound ahead of it,
+    // see BuildOptions::indirectDraws. Alongside the draws it carries OBJECT_SIZE vec4 per draw, the draw's bounding sphere followed by
+    // the columns of its model matrix, laid out for a compute pass to cull the draws by writing their instanceCount.
+    class OSG2VSG_DECLSPEC DrawIndexedIndirect : public vsg::Inherit<vsg::Command, DrawIndexedIndirect>
+    {
+    public:
+        DrawIndexedIndirect();
+        DrawIndexedIndirect(vsg::ref_ptr<vsg::uintArray> in_draws, vsg::ref_ptr<vsg::vec4Array> in_objects);
+
+        static const uint32_t DRAW_SIZE = 5;
+        static const uint32_t OBJECT_SIZE = 5;
+
+        vsg::ref_ptr<vsg::uintArray> draws;
+        vsg::ref_ptr<vsg::vec4Array> objects;
+
+        // issue all the draws with one vkCmdDrawIndexedIndirect, which needs the multiDrawIndirect device feature,
+        // otherwise each draw is issued with its own vkCmdDrawIndexedIndirect from the same buffer
+        bool multiDrawIndirect = false;
+
+        uint32_t drawCount() const { return draws ? static_cast<uint32_t>(draws->valueCount() / DRAW_SIZE) : 0; }
+
+        void read(vsg::Input& input) override;
+        void write(vsg::Output& output) const override;
+
+        void compile(vsg::Context& context) override;
+        void record(vsg::CommandBuffer& commandBuffer) const override;
+
+    protected:
+        vsg::ref_ptr<vsg::Buffer> _buffer;
+        VkDeviceSize _offset = 0;
+    };
+}
+
+VSG_type_name(osg2vsg::DrawIndexedIndirect);
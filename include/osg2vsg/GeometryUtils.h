@@ -1,12 +1,16 @@
 #pragma once
 
 #include <osg2vsg/Export.h>
+#include <osg2vsg/ArrayUtils.h>
 #include <vsg/all.h>
 
 #include <osg/Array>
 #include <osg/Geometry>
 #include <osg/Material>
 
+#include <atomic>
+#include <ostream>
+
 namespace osg2vsg
 {
     enum GeometryAttributes : uint32_t
@@ -23,8 +27,14 @@ namespace osg2vsg
         TEXCOORD2 = 512,
         TRANSLATE = 1024,
         TRANSLATE_OVERALL = 2048,
+        BONES = 32768, // per vertex bone indices and weights in vertex attrib arrays 12 and 13, see createSkinnedGeometry()
         STANDARD_ATTS = VERTEX | NORMAL | TANGENT | COLOR | TEXCOORD0,
-        ALL_ATTS = VERTEX | NORMAL | NORMAL_OVERALL | TANGENT | TANGENT_OVERALL | COLOR | COLOR_OVERALL | TEXCOORD0 | TEXCOORD1 | TEXCOORD2 | TRANSLATE | TRANSLATE_OVERALL
+        ALL_ATTS = VERTEX | NORMAL | NORMAL_OVERALL | TANGENT | TANGENT_OVERALL | COLOR | COLOR_OVERALL | TEXCOORD0 | TEXCOORD1 | TEXCOORD2 | TRANSLATE | TRANSLATE_OVERALL | BONES,
+
+        // layout flags, these don't add attributes but change how the attributes are packed into vertex buffers
+        INTERLEAVED = 4096, // pack all per vertex attributes into a single interleaved vertex buffer
+        QUANTIZED = 8192, // store normals, tangents, colors and texcoord0 in compact formats, see quantizeNormals() etc.
+        INSTANCE_MATRIX = 16384 // per instance model matrix, read from the columns in vertex attrib arrays 8 to 11 bound overall
     };
 
     enum AttributeChannels : uint32_t
@@ -36,26 +46,100 @@ namespace osg2vsg
         TEXCOORD0_CHANNEL = 4, //osg 3
         TEXCOORD1_CHANNEL = 5,
         TEXCOORD2_CHANNEL = 6,
-        TRANSLATE_CHANNEL = 7
+        TRANSLATE_CHANNEL = 7,
+        INSTANCE_MATRIX_CHANNEL = 8, // osg 8 to 11, one location per column
+        BONE_INDICES_CHANNEL = 12, // osg 12
+        BONE_WEIGHTS_CHANNEL = 13 // osg 13
     };
 
+    // the node form convertToVsg() creates. A vsg::VertexIndexDraw binds and draws in a single command but only holds one draw, a vsg::Geometry
+    // binds once for any number of draws, while vsg::Commands traverses the binds and each draw as separate child commands. VSG_AUTO picks
+    // the cheapest form able to hold each geometry's draws, with the choices counted in GeometryStats.
     enum GeometryTarget : uint32_t
     {
         VSG_GEOMETRY,
         VSG_VERTEXINDEXDRAW,
-        VSG_COMMANDS
+        VSG_COMMANDS,
+        VSG_AUTO
+    };
+
+    struct VertexAttribute
+    {
+        uint32_t location; // AttributeChannels
+        VkFormat format;
+        uint32_t size; // size in bytes of a single element
+        VkVertexInputRate inputRate;
+        uint32_t stride; // size in bytes between elements, 0 when a single value is shared by every vertex and instance
     };
 
-    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec2Array> convertToVsg(const osg::Vec2Array* inarray, uint32_t bindOverallPaddingCount);
+    using VertexAttributes = std::vector<VertexAttribute>;
+
+    // the vertex attributes, in binding order, used by both the converted geometry and the graphics pipeline for the specified geometry attributes mask
+    extern OSG2VSG_DECLSPEC VertexAttributes computeVertexAttributes(uint32_t geometryAttributesMask);
+
+    // octahedral encoded unit normals, each stored as two 16 bit signed normalized values, decoded in the vertex shader
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::svec2Array> quantizeNormals(const vsg::vec3Array* normals);
+
+    // tangents stored as four 16 bit signed normalized values
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::svec4Array> quantizeTangents(const vsg::vec4Array* tangents);
+
+    // colors stored as four 8 bit unsigned normalized values
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::ubvec4Array> quantizeColors(const vsg::vec4Array* colors);
+
+    // texture coordinates stored as two half floats, so that repeating texture coordinates outside the 0 to 1 range are retained
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::usvec2Array> quantizeTexCoords(const vsg::vec2Array* texcoords);
+
+    // statistics accumulated by the geometry conversions sharing a GeometryOptions, updated atomically so conversions may run in parallel
+    struct GeometryStats : public vsg::Inherit<vsg::Object, GeometryStats>
+    {
+        std::atomic<uint64_t> numGeometriesWelded{0};
+        std::atomic<uint64_t> numVerticesBeforeWeld{0};
+        std::atomic<uint64_t> numVerticesAfterWeld{0};
+
+        // the node forms created by convertToVsg(), and why a vsg::Geometry was needed
+        std::atomic<uint64_t> numVertexIndexDraws{0};
+        std::atomic<uint64_t> numGeometries{0};
+        std::atomic<uint64_t> numCommands{0};
+        std::atomic<uint64_t> numGeometriesWithMultipleDraws{0};
+        std::atomic<uint64_t> numGeometriesWithoutIndices{0};
+        std::atomic<uint64_t> numVertexIndexDrawFallbacks{0};
+
+        void print(std::ostream& out) const;
+    };
+
+    struct GeometryOptions
+    {
+        // when the indices of a mesh don't fit in 16 bits, split the mesh into index ranges that do and
+        // draw each range with its own vertexOffset, rather than falling back to 32 bit indices
+        bool splitLargeMeshes = false;
 
-    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3Array* inarray, uint32_t bindOverallPaddingCount);
+        // limits on the size of the clusters created by convertToClusters()
+        uint32_t maxClusterVertices = 64;
+        uint32_t maxClusterTriangles = 124;
 
-    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec4Array> convertToVsg(const osg::Vec4Array* inarray, uint32_t bindOverallPaddingCount);
+        // the meshes simplified by convertToLOD(), the number of levels each halving the triangles, and the screen space error allowed in pixels
+        uint32_t lodMinTriangles = 10000;
+        uint32_t numLODLevels = 3;
+        double lodPixelError = 1.0;
 
-    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Data> convertToVsg(const osg::Array* inarray, uint32_t bindOverallPaddingCount);
+        // converted arrays shared between geometries using the same osg::Array, set to null to convert every array afresh
+        vsg::ref_ptr<ArrayCache> arrayCache = ArrayCache::create();
+
+        // convert Vec3dArray vertices to float offsets from the center of their bounds, with the caller placing the converted
+        // geometry under a transform to that origin, see createRelativeToCenterTransform()
+        bool relativeToCenter = false;
+
+        // merge duplicate vertices during conversion, see weldVertices(), float attributes within weldTolerance of each other are merged.
+        // Geometries with a per vertex array whose length differs from the vertex array are left unwelded
+        bool weldVertices = false;
+        float weldTolerance = 0.0f;
+
+        vsg::ref_ptr<GeometryStats> stats = GeometryStats::create();
+    };
 
     extern OSG2VSG_DECLSPEC uint32_t calculateAttributesMask(const osg::Geometry* geometry);
 
+    // topology of the primitives that convertToVsg(osg::Geometry*) produces for primitive sets of primitiveMode
     extern OSG2VSG_DECLSPEC VkPrimitiveTopology convertToTopology(osg::PrimitiveSet::Mode primitiveMode);
 
     extern OSG2VSG_DECLSPEC VkSamplerAddressMode covertToSamplerAddressMode(osg::Texture::WrapMode wrapmode);
@@ -66,6 +150,48 @@ namespace osg2vsg
 
     extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::materialValue> convertToMaterialValue(const osg::Material* material);
 
-    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Command> convertToVsg(osg::Geometry* geometry, uint32_t requiredAttributesMask, GeometryTarget geometryTarget);
+    // merge geometries that share the same state and transform into combined geometries, binned into cells of cellSize so that each
+    // combined geometry stays spatially compact for culling, and capped at maxVertices vertices. A cellSize of 0 divides the bounds of
+    // the geometries into 4 cells along their longest axis. Geometries that can't be merged are returned unchanged.
+    extern OSG2VSG_DECLSPEC std::vector<osg::ref_ptr<osg::Geometry>> batchGeometries(const std::vector<osg::ref_ptr<osg::Geometry>>& geometries, double cellSize, uint32_t maxVertices);
+
+    // generate per vertex tangents for the triangles of the geometry from its vertices, normals and texcoord0, with the handedness of the
+    // bitangent in w. The geometry isn't modified so it's safe to call concurrently. Returns null if the geometry lacks the required arrays.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::vec4Array> generateTangents(const osg::Geometry* geometry);
+
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Command> convertToVsg(osg::Geometry* geometry, uint32_t requiredAttributesMask, GeometryTarget geometryTarget, const GeometryOptions& geometryOptions = GeometryOptions());
+
+    // the local origin that geometry's vertices are converted relative to when GeometryOptions::relativeToCenter is set, the center of the bounds
+    // of its Vec3dArray vertices. Returns false when the geometry is converted as is, as for float vertices, instanced and skinned geometries.
+    extern OSG2VSG_DECLSPEC bool computeRelativeToCenterOrigin(const osg::Geometry* geometry, const GeometryOptions& geometryOptions, vsg::dvec3& origin);
+
+    // place the node converted from geometry under a vsg::MatrixTransform translating it to its relative to center origin, returning the
+    // node unchanged when the geometry isn't converted relative to center
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Node> createRelativeToCenterTransform(const osg::Geometry* geometry, vsg::ref_ptr<vsg::Node> node, const GeometryOptions& geometryOptions);
+
+    // near minimal bounding sphere of the geometry's vertices, see computeBoundingSphere(const vsg::vec3*, size_t), falling back to the sphere
+    // around the geometry's bounding box when the vertices aren't a Vec3Array or Vec3dArray
+    extern OSG2VSG_DECLSPEC vsg::sphere computeBoundingSphere(const osg::Geometry* geometry);
+
+    // create a geometry drawing the source geometry once per matrix, sharing its arrays and primitive sets, with the matrices' columns added
+    // as the vertex attrib arrays bound overall that the INSTANCE_MATRIX attributes are read from
+    extern OSG2VSG_DECLSPEC osg::ref_ptr<osg::Geometry> createInstancedGeometry(const osg::Geometry* geometry, const std::vector<osg::Matrix>& matrices);
+
+    // convert a triangle mesh into a group that binds its arrays followed by a vsg::CullNode per cluster of its triangles, see buildClusters().
+    // The group's "Clusters" object is a vec4Array table of two entries per cluster, the bounding sphere's center and radius then the normal cone's
+    // axis and cutoff, for visitors that cull clusters facing away from the eye. Returns null for geometries that aren't non instanced triangle meshes,
+    // which are rejected before being converted, and the converted vsg::Geometry for meshes that turn out not to cluster once converted.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Node> convertToClusters(osg::Geometry* geometry, uint32_t requiredAttributesMask, const GeometryOptions& geometryOptions = GeometryOptions());
+
+    using LODChildMap = std::map<double, vsg::ref_ptr<vsg::Node>>;
+
+    // create a vsg::LOD from children keyed by their minimum screen height ratio
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::LOD> createLOD(const vsg::dsphere& bound, const LODChildMap& ratioChildMap);
+
+    // convert a triangle mesh of at least lodMinTriangles triangles into a vsg::LOD of simplified levels, see simplifyMesh(), that share the vertex
+    // arrays and a single index array. The screen height ratio of each level comes from the error of the next coarser level. Returns null for
+    // geometries rejected before being converted, such as those below lodMinTriangles, and the converted vsg::Geometry for meshes that
+    // turn out not to simplify once converted.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Node> convertToLOD(osg::Geometry* geometry, uint32_t requiredAttributesMask, const GeometryOptions& geometryOptions = GeometryOptions());
 
 }
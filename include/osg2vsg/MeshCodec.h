@@ -0,0 +1,65 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+#include <map>
+#include <ostream>
+
+namespace osg2vsg
+{
+    // encode a converted vertex or index array into a compact ubyteArray for serialization. Each component is delta encoded against the same
+    // component of the previous value, zigzag mapped and written as a variable length integer, so index lists and vertex fetch ordered vertex
+    // arrays shrink to a byte or two per component. Float components are encoded losslessly from their bit patterns unless quantizationBits
+    // is between 1 and 24, in which case they're first quantized to that many bits across the range of each component. Returns null for
+    // arrays of types that aren't supported.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::ubyteArray> encodeArray(const vsg::Data* array, uint32_t quantizationBits = 0);
+
+    // true if data is an array encoded by encodeArray()
+    extern OSG2VSG_DECLSPEC bool isEncodedArray(const vsg::Data* data);
+
+    // expand an array encoded by encodeArray() back into the vsg::Data of its original type, null if data isn't a valid encoded array
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<vsg::Data> decodeArray(const vsg::Data* data);
+
+    // replace the vertex arrays and indices of the vsg::Geometry and vsg::VertexIndexDraw in a scene graph, and the arrays of
+    // vsg::BindVertexBuffers, by their encoded form ahead of writing the scene graph out. Arrays shared between meshes stay shared,
+    // and arrays that don't get smaller are left as they are. The indices of vsg::BindIndexBuffer aren't encoded.
+    class EncodeMeshes : public vsg::Visitor
+    {
+    public:
+        EncodeMeshes(uint32_t in_quantizationBits = 0) :
+            quantizationBits(in_quantizationBits) {}
+
+        uint32_t quantizationBits;
+
+        void apply(vsg::Object& object) override;
+        void apply(vsg::Geometry& geometry) override;
+        void apply(vsg::VertexIndexDraw& vid) override;
+        void apply(vsg::BindVertexBuffers& bvb) override;
+
+        void print(std::ostream& out) const;
+
+        uint64_t numBytesBefore = 0;
+        uint64_t numBytesAfter = 0;
+
+    protected:
+        vsg::ref_ptr<vsg::Data> encode(vsg::ref_ptr<vsg::Data> data);
+
+        std::map<vsg::Data*, vsg::ref_ptr<vsg::Data>> _encoded;
+    };
+
+    // expand the arrays encoded by EncodeMeshes back into vsg::Data so that a loaded scene graph can be compiled
+    class DecodeMeshes : public vsg::Visitor
+    {
+    public:
+        void apply(vsg::Object& object) override;
+        void apply(vsg::Geometry& geometry) override;
+        void apply(vsg::VertexIndexDraw& vid) override;
+        void apply(vsg::BindVertexBuffers& bvb) override;
+
+    protected:
+        vsg::ref_ptr<vsg::Data> decode(vsg::ref_ptr<vsg::Data> data);
+
+        std::map<vsg::Data*, vsg::ref_ptr<vsg::Data>> _decoded;
+    };
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+#include <ostream>
+#include <set>
+#include <thread>
+
+namespace osg2vsg
+{
+    // reorder the triangles of a triangle list for the post transform vertex cache, using Tom Forsyth's linear speed vertex cache optimization
+    extern OSG2VSG_DECLSPEC std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+    // remap from the original vertex index to the position at which the indices first use that vertex, unused vertices are moved to the end
+    extern OSG2VSG_DECLSPEC std::vector<uint32_t> computeVertexFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+    // number of vertex shader invocations needed to draw the indices through a FIFO post transform cache of cacheSize entries,
+    // divide by the number of triangles to get the average cache miss ratio (ACMR)
+    extern OSG2VSG_DECLSPEC uint64_t computeCacheMisses(const std::vector<uint32_t>& indices, uint32_t cacheSize = 16);
+
+    // reorder the clusters of a vertex cache optimized triangle list so that the clusters facing out from the center of the mesh, those most likely
+    // to be in front from typical viewpoints, are drawn first to reduce overdraw, after Sander et al. "Fast Triangle Reordering for Vertex Locality
+    // and Reduced Overdraw". Clusters end where the cache order starts afresh, and are split further while their cache miss ratio stays within
+    // threshold of the unsplit cluster's.
+    extern OSG2VSG_DECLSPEC std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, float threshold = 1.05f, uint32_t cacheSize = 16);
+
+    // simplify a triangle list towards targetIndexCount indices by collapsing edges in the order of least quadric error, moving vertices onto
+    // their neighbours so the simplified indices still address the original vertices. Vertices on open borders, and vertices sharing their position
+    // with another vertex such as along texture seams, are kept in place. The error, an estimate of the greatest distance of the simplified surface
+    // from the original, is returned in resultError.
+    extern OSG2VSG_DECLSPEC std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, size_t targetIndexCount, float* resultError = nullptr);
+
+    // near minimal sphere enclosing the points using Ritter's algorithm, starting from the most separated pair of the extreme points along each
+    // axis then growing the sphere to take in each point outside it. An empty set of points gives a sphere with a negative radius.
+    extern OSG2VSG_DECLSPEC vsg::sphere computeBoundingSphere(const vsg::vec3* points, size_t numPoints);
+
+    // smallest sphere enclosing both spheres, spheres with a negative radius are treated as empty
+    extern OSG2VSG_DECLSPEC vsg::sphere mergeBoundingSpheres(const vsg::sphere& lhs, const vsg::sphere& rhs);
+
+    // a cluster of the triangles of a mesh, bounded by a sphere and a cone containing the normals of its triangles. The whole cluster faces away
+    // from a camera at eye when dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius, a coneCutoff of 1 never culls.
+    struct Cluster
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        vsg::sphere bound;
+        vsg::vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    using Clusters = std::vector<Cluster>;
+
+    // partition a triangle list into clusters of at most maxVertices unique vertices and maxTriangles triangles, growing each cluster from
+    // the triangles adjacent to it. The indices are reordered so that each cluster's triangles are contiguous.
+    extern OSG2VSG_DECLSPEC Clusters buildClusters(std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+    // merge the vertices that are equal in all the arrays holding vertexCount values, comparing float arrays to within tolerance and the
+    // other arrays bitwise, then remap the indices to the merged vertices. The welded arrays are replaced by compacted copies, arrays with
+    // other counts, such as those bound overall, are left as is. Returns the number of vertices after welding.
+    extern OSG2VSG_DECLSPEC uint32_t weldVertices(std::vector<uint32_t>& indices, vsg::DataList& arrays, uint32_t vertexCount, float tolerance = 0.0f);
+
+    // reorder the indices of the indexed triangle meshes in a converted vsg scene graph for the post transform vertex cache, and
+    // optionally for overdraw when drawn by pipelines without blending, then
+    // reorder their vertex arrays into the order in which the indices first use them. Vertex arrays shared with other meshes, or held by an
+    // ArrayCache, are left in place. Meshes drawn in several DrawIndexed ranges, including those recorded in vsg::Commands and the cluster
+    // leaves of convertToClusters(), have each range's triangles reordered within the range. The meshes are optimized in parallel.
+    class OptimizeMeshes : public vsg::Visitor
+    {
+    public:
+        OptimizeMeshes(uint32_t in_numThreads = std::thread::hardware_concurrency());
+
+        uint32_t numThreads;
+
+        // reorder the triangles of opaque meshes for overdraw after the vertex cache optimization, see optimizeOverdraw()
+        bool reduceOverdraw = false;
+        float overdrawThreshold = 1.05f;
+
+        // topology of the meshes not drawn under a BindGraphicsPipeline, such as those converted ahead of being packed into arenas,
+        // only the ranges drawn as triangle lists are optimized
+        VkPrimitiveTopology defaultTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        void apply(vsg::Object& object) override;
+        void apply(vsg::Group& group) override;
+        void apply(vsg::StateGroup& stategroup) override;
+        void apply(vsg::Commands& commands) override;
+        void apply(vsg::Geometry& geometry) override;
+        void apply(vsg::VertexIndexDraw& vid) override;
+        void apply(vsg::BindVertexBuffers& bvb) override;
+        void apply(vsg::BindIndexBuffer& bib) override;
+
+        // optimize the meshes collected by the traversal
+        void optimize();
+
+        void print(std::ostream& out) const;
+
+        // statistics accumulated by optimize()
+        uint32_t numMeshesOptimized = 0;
+        uint32_t numMeshesSkipped = 0;
+        uint64_t numTriangles = 0;
+        uint64_t numCacheMissesBefore = 0;
+        uint64_t numCacheMissesAfter = 0;
+
+        // the indices drawn by a DrawIndexed, which address the vertices from vertexOffset, as primitives of the pipeline's topology
+        struct Range
+        {
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            int32_t vertexOffset = 0;
+            VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        };
+
+        struct Mesh
+        {
+            vsg::DataList arrays;
+            vsg::ref_ptr<vsg::Data> indices;
+            std::vector<Range> ranges;
+            uint32_t instanceCount = 1;
+            bool reorderVertices = true;
+            float overdrawThreshold = 0.0f; // 0 when the triangles aren't reordered for overdraw
+
+            uint64_t numTriangles = 0;
+            uint64_t numCacheMissesBefore = 0;
+            uint64_t numCacheMissesAfter = 0;
+        };
+
+    protected:
+        void addMesh(const vsg::DataList& arrays, vsg::ref_ptr<vsg::Data> indices, std::vector<Range> ranges, uint32_t instanceCount);
+
+        // the binds and draws gathered while traversing a vsg::Commands or a cluster leaf, which are optimized as one mesh
+        struct Recorded
+        {
+            vsg::DataList arrays;
+            vsg::ref_ptr<vsg::Data> indices;
+            std::vector<Range> ranges;
+            uint32_t instanceCount = 1;
+            bool supported = true;
+        };
+
+        void addRecorded(const Recorded& recorded);
+
+        // topology of the pipeline drawing the current subgraph, or defaultTopology outside any pipeline
+        VkPrimitiveTopology currentTopology() const { return _topology != VK_PRIMITIVE_TOPOLOGY_MAX_ENUM ? _topology : defaultTopology; }
+
+        std::set<vsg::Object*> _visited;
+        bool _blended = false;
+        VkPrimitiveTopology _topology = VK_PRIMITIVE_TOPOLOGY_MAX_ENUM;
+        Recorded* _recording = nullptr;
+        std::vector<Mesh> _meshes;
+    };
+}
@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <chrono>
+#include <thread>
 
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
@@ -13,6 +14,8 @@
 
 #include <osg2vsg/ShaderUtils.h>
 #include <osg2vsg/GeometryUtils.h>
+#include <osg2vsg/Skinning.h>
+#include <osg2vsg/TextUtils.h>
 
 namespace osg2vsg
 {
@@ -35,8 +38,58 @@ namespace osg2vsg
         bool insertCullNodes = true;
         bool useBindDescriptorSet = true;
         bool billboardTransform = false;
+        bool interleaveVertexArrays = false;
+        bool quantizeVertexAttributes = false;
 
-        GeometryTarget geometryTarget = VSG_VERTEXINDEXDRAW;
+        // merge the geometries sharing state and transform into combined geometries, see batchGeometries()
+        bool batchGeometries = false;
+        double batchCellSize = 0.0;
+        uint32_t batchMaxVertices = 65535;
+
+        // sub-allocate the converted vertex and index arrays of each pipeline from shared arenas, drawn by offset. Ignored when
+        // generateLODs or generateClusters is set, as their subgraphs draw from arrays of their own
+        bool packArenas = false;
+
+        // draw the arena draws of each state and transform with a single DrawIndexedIndirect rather than a subgraph of draws, requires packArenas
+        bool indirectDraws = false;
+
+        // issue each DrawIndexedIndirect's draws with a single call, the device must be created with the multiDrawIndirect feature
+        bool multiDrawIndirect = false;
+
+        // draw triangle meshes as clusters of triangles, each with its own CullNode, see convertToClusters()
+        bool generateClusters = false;
+
+        // replace large triangle meshes by a vsg::LOD of simplified levels, see convertToLOD()
+        bool generateLODs = false;
+
+        // cull with near minimal spheres computed from the vertices rather than the spheres around the bounding boxes
+        bool tightBounds = false;
+
+        // draw geometries repeated under at least minInstances transforms as one instanced draw with per instance matrices
+        bool instanceGeometries = false;
+        uint32_t minInstances = 4;
+
+        // drop the vertex arrays that the built in shaders won't read for the state's shader mode, see stripUnusedGeometryAttributes(),
+        // ignored when custom shaders are used
+        bool stripUnusedAttributes = true;
+
+        // reorder the triangles of opaque meshes so the outward facing clusters are drawn first, see optimizeOverdraw()
+        bool reduceOverdraw = false;
+
+        // optimize the meshes of the pipelines packed into arenas before packing, see OptimizeMeshes, as their draws can't be
+        // optimized once they index into the arenas
+        bool optimizeMeshes = true;
+
+        // write the vertex and index arrays of the converted meshes in the compact form of EncodeMeshes, quantizing float attributes to
+        // encodeQuantizationBits when non zero. Loaders expand them again with DecodeMeshes.
+        bool encodeMeshes = false;
+        uint32_t encodeQuantizationBits = 0;
+
+        // threads used by createVSG() to convert the unique geometries in parallel ahead of assembling the scene graph, 1 converts them serially
+        uint32_t numThreads = std::thread::hardware_concurrency();
+
+        GeometryTarget geometryTarget = VSG_AUTO;
+        GeometryOptions geometryOptions;
 
         uint32_t supportedGeometryAttributes = GeometryAttributes::ALL_ATTS;
         uint32_t supportedShaderModeMask = ShaderModeMask::ALL_SHADER_MODE_MASK;
@@ -63,7 +116,7 @@ namespace osg2vsg
         using StateSets = std::set<StateStack>;
         using StatePair = std::pair<osg::ref_ptr<osg::StateSet>, osg::ref_ptr<osg::StateSet>>;
         using StateMap = std::map<StateStack, StatePair>;
-        using GeometriesMap = std::map<const osg::Geometry*, vsg::ref_ptr<vsg::Command>>;
+        using GeometriesMap = std::map<const osg::Geometry*, vsg::ref_ptr<vsg::Node>>;
 
 
         using TexturesMap = std::map<const osg::Texture*, vsg::ref_ptr<vsg::DescriptorImage>>;
@@ -132,12 +185,60 @@ namespace osg2vsg
         MasksTransformStateMap masksTransformStateMap;
         GeometriesMap geometriesMap;
 
+        using BoundsMap = std::map<const osg::Geometry*, vsg::sphere>;
+        BoundsMap boundsMap;
+
+        // the rigs found in the osg scene graph, drawn through their bind pose geometries with the SKINNING shader mode. Update the
+        // SkinnedGeometry each frame once the osg update traversal has posed the bones.
+        using SkinnedGeometries = std::map<const osgAnimation::RigGeometry*, vsg::ref_ptr<SkinnedGeometry>>;
+        SkinnedGeometries skinnedGeometries;
+
+        // the osgText::Text drawables found in the osg scene graph, laid out in world coordinates and batched by state, with the glyphs
+        // of all their fonts packed into the one atlas
+        using TextBatches = std::map<StateStack, vsg::ref_ptr<TextBatch>>;
+        TextBatches textBatches;
+        vsg::ref_ptr<GlyphAtlas> glyphAtlas;
+
+        // add a geometry for each of the text batches to the geometries to build, called by createVSG() and createOSG()
+        void addTextGeometries();
+
+        // the cull sphere of a geometry, or of the geometries placed under a transform, see BuildOptions::tightBounds
+        vsg::sphere computeBound(const osg::Geometry* geometry);
+        vsg::sphere computeBound(const Geometries& geometries, const osg::Matrix& matrix);
+
         osg::ref_ptr<osg::Node> createStateGeometryGraphOSG(StateGeometryMap& stateGeometryMap);
         osg::ref_ptr<osg::Node> createTransformGeometryGraphOSG(TransformGeometryMap& transformGeometryMap);
         osg::ref_ptr<osg::Node> createOSG();
 
+        // move the geometries repeated under many transforms into instanced geometries, see BuildOptions::instanceGeometries
+        void instanceGeometries(MasksTransformStateMap& masksMap);
+
+        // the shader mode and geometry attribute masks of the pipeline for the masks gathered from the osg scene graph
+        std::pair<uint32_t, uint32_t> computePipelineMasks(const Masks& masks) const;
+
+        // true when the geometries of the pipeline with geometrymask are packed into arenas, see BuildOptions::packArenas
+        bool usesArenas(uint32_t geometrymask) const;
+
+        // convert a geometry to the leaf placed in geometriesMap, as a LOD or clusters when enabled, under its relative to center transform.
+        // Reads only the build options so is safe to call concurrently.
+        vsg::ref_ptr<vsg::Node> convertGeometry(osg::Geometry* geometry, uint32_t requiredGeomAttributesMask) const;
+
+        // convert the geometries of all the pipelines not yet in geometriesMap in parallel, see BuildOptions::numThreads, leaving
+        // createTransformGeometryGraphVSG() to link the results into the scene graph
+        void convertGeometries(const MasksTransformStateMap& masksMap);
+
         vsg::ref_ptr<vsg::Node> createTransformGeometryGraphVSG(TransformGeometryMap& transformGeometryMap, vsg::Paths& searchPaths, uint32_t requiredGeomAttributesMask);
 
+        using ConvertedGeometries = std::vector<std::pair<const osg::Geometry*, vsg::ref_ptr<vsg::Geometry>>>;
+
+        // pack the arrays of the converted geometries into arenas, assigning the draws into the arenas to leaves and returning the commands
+        // that bind the arenas, or return null if the geometries can't share arenas
+        vsg::ref_ptr<vsg::Commands> packArenas(const ConvertedGeometries& convertedGeometries, GeometriesMap& leaves);
+
+        // gather the arena draws of the geometries under each transform into a DrawIndexedIndirect, see BuildOptions::indirectDraws,
+        // or return null if any of the geometries isn't drawn directly from the arenas
+        vsg::ref_ptr<vsg::Node> createIndirectGeometryGraphVSG(TransformGeometryMap& transformGeometryMap);
+
         vsg::ref_ptr<vsg::Node> createVSG(vsg::Paths& searchPaths);
 
         void apply(osg::Node& node);
@@ -145,6 +246,7 @@ namespace osg2vsg
         void apply(osg::Transform& transform);
         void apply(osg::Billboard& billboard);
         void apply(osg::Geometry& geometry);
+        void apply(osg::Drawable& drawable);
 
         void pushStateSet(osg::StateSet& stateset);
         void popStateSet();
@@ -23,7 +23,8 @@ namespace osg2vsg
         NORMAL_MAP = 128,
         SPECULAR_MAP = 256,
         SHADER_TRANSLATE = 512,
-        ALL_SHADER_MODE_MASK = LIGHTING | MATERIAL | BLEND | BILLBOARD | DIFFUSE_MAP | OPACITY_MAP | AMBIENT_MAP | NORMAL_MAP | SPECULAR_MAP | SHADER_TRANSLATE
+        SKINNING = 1024, // blend the vertices by the bone matrices of descriptor set BONE_MATRICES_SET, see createSkinnedGeometry()
+        ALL_SHADER_MODE_MASK = LIGHTING | MATERIAL | BLEND | BILLBOARD | DIFFUSE_MAP | OPACITY_MAP | AMBIENT_MAP | NORMAL_MAP | SPECULAR_MAP | SHADER_TRANSLATE | SKINNING
     };
 
     // taken from osg fbx plugin
@@ -42,6 +43,10 @@ namespace osg2vsg
 
     extern OSG2VSG_DECLSPEC uint32_t calculateShaderModeMask(const osg::StateSet* stateSet);
 
+    // remove the geometry attributes that the built in shaders don't read for shaderModeMask, normals are only read when lit, tangents when
+    // lit and normal mapped, texcoord0 when a texture map is sampled and bones when skinning. Colors, translations and the layout flags are always kept.
+    extern OSG2VSG_DECLSPEC uint32_t stripUnusedGeometryAttributes(uint32_t shaderModeMask, uint32_t geometryAttributes);
+
     // read a glsl file and inject defines based on shadermodemask and geometryatts
     extern OSG2VSG_DECLSPEC std::string readGLSLShader(const std::string& filename, const uint32_t& shaderModeMask, const uint32_t& geometryAttrbutes);
 
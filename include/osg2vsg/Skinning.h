@@ -0,0 +1,46 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+#include <osg/Geometry>
+#include <osgAnimation/Bone>
+#include <osgAnimation/RigGeometry>
+
+namespace osg2vsg
+{
+    // size of the bone matrix array read by the SKINNING vertex shader, rigs with a larger palette are drawn in their bind pose
+    const uint32_t MAX_BONES = 128;
+
+    // descriptor set and binding of the bone matrices, set 0 holds the material and textures of the state
+    const uint32_t BONE_MATRICES_SET = 1;
+    const uint32_t BONE_MATRICES_BINDING = 0;
+
+    // a osgAnimation::RigGeometry prepared for skinning in the vertex shader. The bind pose geometry carries the up to 4 bone indices and weights
+    // of each vertex in the BONE_INDICES_CHANNEL and BONE_WEIGHTS_CHANNEL vertex attributes, indexing the bone matrices that update() recomputes
+    // from the current pose of the bones. Index 0 is reserved for the identity matrix used by vertices without weights.
+    struct OSG2VSG_DECLSPEC SkinnedGeometry : public vsg::Inherit<vsg::Object, SkinnedGeometry>
+    {
+        osg::ref_ptr<osgAnimation::RigGeometry> rigGeometry;
+        osg::ref_ptr<osg::Geometry> bindPoseGeometry;
+
+        using Bones = std::vector<osg::ref_ptr<osgAnimation::Bone>>;
+        Bones bones;
+
+        // transform from the geometry's coordinate frame to the skeleton's
+        osg::Matrix geometryToSkeleton;
+
+        vsg::ref_ptr<vsg::mat4Array> boneMatrices;
+
+        // the uniform the bone matrices are uploaded through, assigned by SceneBuilder::createVSG()
+        vsg::ref_ptr<vsg::DescriptorBuffer> descriptorBuffer;
+
+        // recompute the bone matrices from the bones' current matrices in skeleton space, call descriptorBuffer->copyDataListToBuffers() after
+        // to upload them
+        void update();
+    };
+
+    // gather the bones of rigGeometry from the nearest osgAnimation::Skeleton above it on nodePath, which should end with the geometry, and
+    // create the bind pose geometry with the bone attributes. Returns null if there's no skeleton or the rig uses more than MAX_BONES - 1 bones.
+    extern OSG2VSG_DECLSPEC vsg::ref_ptr<SkinnedGeometry> createSkinnedGeometry(osgAnimation::RigGeometry* rigGeometry, const osg::NodePath& nodePath);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <osg2vsg/Export.h>
+#include <vsg/all.h>
+
+#include <osg/Geometry>
+#include <osg/Texture2D>
+#include <osgText/Text>
+
+namespace osg2vsg
+{
+    // the glyphs of every font used by the converted text, packed shelf by shelf into a single texture so that text in any font can share a draw
+    class OSG2VSG_DECLSPEC GlyphAtlas : public vsg::Inherit<vsg::Object, GlyphAtlas>
+    {
+    public:
+        GlyphAtlas(uint32_t in_width = 1024, uint32_t in_maxHeight = 4096);
+
+        // pixel position of the glyph's lower left corner in the atlas, packing it on first use. Returns false once the atlas is full
+        // or its texture has been created.
+        bool getPosition(osgText::Glyph* glyph, osg::Vec2& position);
+
+        uint32_t width() const { return _width; }
+
+        // height of the packed glyphs rounded up to a power of two
+        uint32_t height() const;
+
+        // texture of the packed glyphs, white with the glyphs' coverage in alpha, created on the first call after which no more glyphs are packed
+        osg::Texture2D* getTexture();
+
+        // state drawing through the atlas texture, blended and unlit
+        osg::StateSet* getStateSet();
+
+    protected:
+        uint32_t _width;
+        uint32_t _maxHeight;
+
+        uint32_t _shelfX = 0;
+        uint32_t _shelfY = 0;
+        uint32_t _shelfHeight = 0;
+
+        std::map<osg::ref_ptr<osgText::Glyph>, osg::Vec2> _positions;
+
+        osg::ref_ptr<osg::Texture2D> _texture;
+        osg::ref_ptr<osg::StateSet> _stateset;
+    };
+
+    // the glyph quads of osgText::Text drawables sharing a state, gathered into a single triangle list drawn through a GlyphAtlas
+    class OSG2VSG_DECLSPEC TextBatch : public vsg::Inherit<vsg::Object, TextBatch>
+    {
+    public:
+        // lay out the glyphs of text left to right by its alignment, line spacing, rotation and position, then transform them by matrix.
+        // Text sized in screen coordinates or rotated to the screen is laid out as if in object coordinates along its rotation.
+        void add(const osgText::Text& text, const osg::Matrix& matrix, GlyphAtlas& atlas);
+
+        uint32_t numTexts() const { return _numTexts; }
+        bool empty() const { return _vertices->empty(); }
+
+        // geometry of the quads with their texture coordinates into atlas under the atlas's state, creating the atlas's texture
+        osg::ref_ptr<osg::Geometry> createGeometry(GlyphAtlas& atlas) const;
+
+    protected:
+        osg::ref_ptr<osg::Vec3Array> _vertices = new osg::Vec3Array;
+        osg::ref_ptr<osg::Vec4Array> _colors = new osg::Vec4Array;
+        std::vector<osg::Vec2> _texels;
+        uint32_t _numTexts = 0;
+    };
+}
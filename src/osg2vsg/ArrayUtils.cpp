@@ -0,0 +1,229 @@
+#include <osg2vsg/ArrayUtils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace osg2vsg
+{
+
+    namespace
+    {
+        template<typename T>
+        struct ComponentType { using type = typename T::value_type; };
+
+        template<>
+        struct ComponentType<float> { using type = float; };
+
+        template<typename T>
+        void padWithLastValue(T* values, uint32_t count, uint32_t targetSize)
+        {
+            if (count > 0 && count < targetSize) std::fill(values + count, values + targetSize, values[count - 1]);
+        }
+
+        // source and destination share the same memory layout so copy the whole block at once
+        template<class A>
+        vsg::ref_ptr<A> copyValues(const osg::Array* inarray, uint32_t bindOverallPaddingCount)
+        {
+            using value_type = typename A::value_type;
+
+            uint32_t count = inarray->getNumElements();
+            if (count == 0 || inarray->getTotalDataSize() != count * sizeof(value_type)) return {};
+
+            auto outarray = A::create(std::max(count, bindOverallPaddingCount));
+            value_type* dest = static_cast<value_type*>(outarray->dataPointer());
+
+            std::memcpy(dest, inarray->getDataPointer(), inarray->getTotalDataSize());
+            padWithLastValue(dest, count, outarray->valueCount());
+
+            return outarray;
+        }
+
+        // convert component by component as a single flat loop over the contiguous components, which compilers
+        // vectorize for the double to float narrowing and the integer to float conversions
+        template<class A, typename S>
+        vsg::ref_ptr<A> convertValues(const osg::Array* inarray, uint32_t bindOverallPaddingCount)
+        {
+            using value_type = typename A::value_type;
+            using component_type = typename ComponentType<value_type>::type;
+            constexpr uint32_t numComponents = sizeof(value_type) / sizeof(component_type);
+
+            uint32_t count = inarray->getNumElements();
+            if (count == 0 || inarray->getDataSize() != numComponents || inarray->getTotalDataSize() != count * numComponents * sizeof(S)) return {};
+
+            auto outarray = A::create(std::max(count, bindOverallPaddingCount));
+
+            const S* src = static_cast<const S*>(inarray->getDataPointer());
+            component_type* dest = static_cast<component_type*>(outarray->dataPointer());
+            uint32_t numValues = count * numComponents;
+
+            if (std::is_integral<S>::value && inarray->getNormalize())
+            {
+                const component_type scale = component_type(1) / static_cast<component_type>(std::numeric_limits<S>::max());
+                for(uint32_t i = 0; i < numValues; ++i) dest[i] = static_cast<component_type>(src[i]) * scale;
+            }
+            else
+            {
+                for(uint32_t i = 0; i < numValues; ++i) dest[i] = static_cast<component_type>(src[i]);
+            }
+
+            padWithLastValue(static_cast<value_type*>(outarray->dataPointer()), count, outarray->valueCount());
+
+            return outarray;
+        }
+    }
+
+    vsg::ref_ptr<vsg::vec2Array> convertToVsg(const osg::Vec2Array* inarray, uint32_t bindOverallPaddingCount)
+    {
+        if (!inarray) return vsg::ref_ptr<vsg::vec2Array>();
+        return copyValues<vsg::vec2Array>(inarray, bindOverallPaddingCount);
+    }
+
+    vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3Array* inarray, uint32_t bindOverallPaddingCount)
+    {
+        if (!inarray) return vsg::ref_ptr<vsg::vec3Array>();
+        return copyValues<vsg::vec3Array>(inarray, bindOverallPaddingCount);
+    }
+
+    vsg::ref_ptr<vsg::vec4Array> convertToVsg(const osg::Vec4Array* inarray, uint32_t bindOverallPaddingCount)
+    {
+        if (!inarray) return vsg::ref_ptr<vsg::vec4Array>();
+        return copyValues<vsg::vec4Array>(inarray, bindOverallPaddingCount);
+    }
+
+    vsg::ref_ptr<vsg::Data> convertToVsg(const osg::Array* inarray, uint32_t bindOverallPaddingCount)
+    {
+        if (!inarray) return vsg::ref_ptr<vsg::Data>();
+
+        switch (inarray->getType())
+        {
+            case osg::Array::Type::ByteArrayType: return convertValues<vsg::floatArray, int8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::ShortArrayType: return convertValues<vsg::floatArray, int16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::IntArrayType: return convertValues<vsg::floatArray, int32_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::UByteArrayType: return convertValues<vsg::floatArray, uint8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::UShortArrayType: return convertValues<vsg::floatArray, uint16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::UIntArrayType: return convertValues<vsg::floatArray, uint32_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::FloatArrayType: return copyValues<vsg::floatArray>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::DoubleArrayType: return convertValues<vsg::floatArray, double>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2bArrayType: return convertValues<vsg::vec2Array, int8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3bArrayType: return convertValues<vsg::vec3Array, int8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4bArrayType: return convertValues<vsg::vec4Array, int8_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2sArrayType: return convertValues<vsg::vec2Array, int16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3sArrayType: return convertValues<vsg::vec3Array, int16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4sArrayType: return convertValues<vsg::vec4Array, int16_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2iArrayType: return convertValues<vsg::vec2Array, int32_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3iArrayType: return convertValues<vsg::vec3Array, int32_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4iArrayType: return convertValues<vsg::vec4Array, int32_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2ubArrayType: return convertValues<vsg::vec2Array, uint8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3ubArrayType: return convertValues<vsg::vec3Array, uint8_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4ubArrayType: return convertValues<vsg::vec4Array, uint8_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2usArrayType: return convertValues<vsg::vec2Array, uint16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3usArrayType: return convertValues<vsg::vec3Array, uint16_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4usArrayType: return convertValues<vsg::vec4Array, uint16_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2uiArrayType: return convertValues<vsg::vec2Array, uint32_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3uiArrayType: return convertValues<vsg::vec3Array, uint32_t>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4uiArrayType: return convertValues<vsg::vec4Array, uint32_t>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2ArrayType: return copyValues<vsg::vec2Array>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3ArrayType: return copyValues<vsg::vec3Array>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4ArrayType: return copyValues<vsg::vec4Array>(inarray, bindOverallPaddingCount);
+
+            case osg::Array::Type::Vec2dArrayType: return convertValues<vsg::vec2Array, double>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec3dArrayType: return convertValues<vsg::vec3Array, double>(inarray, bindOverallPaddingCount);
+            case osg::Array::Type::Vec4dArrayType: return convertValues<vsg::vec4Array, double>(inarray, bindOverallPaddingCount);
+
+            // matrices, quaternions and 64 bit integers aren't usable as vertex attributes
+            default: return vsg::ref_ptr<vsg::Data>();
+        }
+    }
+
+    vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3dArray* inarray, const vsg::dvec3& origin)
+    {
+        if (!inarray || inarray->empty()) return {};
+
+        auto outarray = vsg::vec3Array::create(static_cast<uint32_t>(inarray->size()));
+
+        // a flat loop over the contiguous components, with no dependency between vertices, which compilers vectorize
+        const double* src = static_cast<const double*>(inarray->getDataPointer());
+        float* dest = static_cast<float*>(outarray->dataPointer());
+        const double ox = origin.x, oy = origin.y, oz = origin.z;
+        size_t count = inarray->size();
+        for(size_t i = 0; i < count; ++i)
+        {
+            dest[i * 3] = static_cast<float>(src[i * 3] - ox);
+            dest[i * 3 + 1] = static_cast<float>(src[i * 3 + 1] - oy);
+            dest[i * 3 + 2] = static_cast<float>(src[i * 3 + 2] - oz);
+        }
+
+        return outarray;
+    }
+
+    vsg::ref_ptr<vsg::Data> copyArray(const osg::Array* inarray)
+    {
+        if (!inarray) return vsg::ref_ptr<vsg::Data>();
+
+        switch (inarray->getType())
+        {
+            case osg::Array::Type::ByteArrayType: return copyValues<vsg::byteArray>(inarray, 0);
+            case osg::Array::Type::ShortArrayType: return copyValues<vsg::shortArray>(inarray, 0);
+            case osg::Array::Type::IntArrayType: return copyValues<vsg::intArray>(inarray, 0);
+
+            case osg::Array::Type::UByteArrayType: return copyValues<vsg::ubyteArray>(inarray, 0);
+            case osg::Array::Type::UShortArrayType: return copyValues<vsg::ushortArray>(inarray, 0);
+            case osg::Array::Type::UIntArrayType: return copyValues<vsg::uintArray>(inarray, 0);
+
+            case osg::Array::Type::FloatArrayType: return copyValues<vsg::floatArray>(inarray, 0);
+            case osg::Array::Type::DoubleArrayType: return copyValues<vsg::doubleArray>(inarray, 0);
+
+            case osg::Array::Type::Vec2bArrayType: return copyValues<vsg::bvec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3bArrayType: return copyValues<vsg::bvec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4bArrayType: return copyValues<vsg::bvec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2sArrayType: return copyValues<vsg::svec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3sArrayType: return copyValues<vsg::svec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4sArrayType: return copyValues<vsg::svec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2iArrayType: return copyValues<vsg::ivec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3iArrayType: return copyValues<vsg::ivec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4iArrayType: return copyValues<vsg::ivec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2ubArrayType: return copyValues<vsg::ubvec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3ubArrayType: return copyValues<vsg::ubvec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4ubArrayType: return copyValues<vsg::ubvec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2usArrayType: return copyValues<vsg::usvec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3usArrayType: return copyValues<vsg::usvec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4usArrayType: return copyValues<vsg::usvec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2uiArrayType: return copyValues<vsg::uivec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3uiArrayType: return copyValues<vsg::uivec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4uiArrayType: return copyValues<vsg::uivec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2ArrayType: return copyValues<vsg::vec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3ArrayType: return copyValues<vsg::vec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4ArrayType: return copyValues<vsg::vec4Array>(inarray, 0);
+
+            case osg::Array::Type::Vec2dArrayType: return copyValues<vsg::dvec2Array>(inarray, 0);
+            case osg::Array::Type::Vec3dArrayType: return copyValues<vsg::dvec3Array>(inarray, 0);
+            case osg::Array::Type::Vec4dArrayType: return copyValues<vsg::dvec4Array>(inarray, 0);
+
+            // osg::Matrixf/d store their rows contiguously with the translation last, matching the column layout of vsg::mat4/dmat4
+            case osg::Array::Type::MatrixArrayType: return copyValues<vsg::mat4Array>(inarray, 0);
+            case osg::Array::Type::MatrixdArrayType: return copyValues<vsg::dmat4Array>(inarray, 0);
+
+            // osg::Quat is four doubles x, y, z, w
+            case osg::Array::Type::QuatArrayType: return copyValues<vsg::dvec4Array>(inarray, 0);
+
+            default: return vsg::ref_ptr<vsg::Data>();
+        }
+    }
+}
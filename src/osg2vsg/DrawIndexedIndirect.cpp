@@ -0,0 +1,67 @@
+#include <osg2vsg/DrawIndexedIndirect.h>
+
+using namespace osg2vsg;
+
+// register so that files written with DrawIndexedIndirect commands can be read back
+vsg::RegisterWithObjectFactoryProxy<DrawIndexedIndirect> s_Register_DrawIndexedIndirect;
+
+static_assert(sizeof(VkDrawIndexedIndirectCommand) == DrawIndexedIndirect::DRAW_SIZE * sizeof(uint32_t), "VkDrawIndexedIndirectCommand isn't packed as DRAW_SIZE uint32_t");
+
+DrawIndexedIndirect::DrawIndexedIndirect()
+{
+}
+
+DrawIndexedIndirect::DrawIndexedIndirect(vsg::ref_ptr<vsg::uintArray> in_draws, vsg::ref_ptr<vsg::vec4Array> in_objects) :
+    draws(in_draws),
+    objects(in_objects)
+{
+}
+
+void DrawIndexedIndirect::read(vsg::Input& input)
+{
+    Command::read(input);
+
+    draws = input.readObject<vsg::uintArray>("Draws");
+    objects = input.readObject<vsg::vec4Array>("Objects");
+    input.read("MultiDrawIndirect", multiDrawIndirect);
+}
+
+void DrawIndexedIndirect::write(vsg::Output& output) const
+{
+    Command::write(output);
+
+    output.writeObject("Draws", draws.get());
+    output.writeObject("Objects", objects.get());
+    output.write("MultiDrawIndirect", multiDrawIndirect);
+}
+
+void DrawIndexedIndirect::compile(vsg::Context& context)
+{
+    // nothing to compile, or already compiled
+    if (!draws || _buffer) return;
+
+    auto bufferDataList = vsg::createBufferAndTransferData(context, vsg::DataList{draws}, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE);
+    if (bufferDataList.empty()) return;
+
+    _buffer = bufferDataList.front()._buffer;
+    _offset = bufferDataList.front()._offset;
+}
+
+void DrawIndexedIndirect::record(vsg::CommandBuffer& commandBuffer) const
+{
+    if (!_buffer) return;
+
+    uint32_t count = drawCount();
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (multiDrawIndirect)
+    {
+        vkCmdDrawIndexedIndirect(commandBuffer, *_buffer, _offset, count, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, *_buffer, _offset + i * stride, 1, stride);
+        }
+    }
+}
@@ -1,108 +1,144 @@
 #include <osg2vsg/GeometryUtils.h>
 #include <osg2vsg/ImageUtils.h>
 #include <osg2vsg/ShaderUtils.h>
+#include <osg2vsg/MeshOptimizer.h>
 
+#include <vsg/nodes/CullNode.h>
 #include <vsg/nodes/StateGroup.h>
 #include <vsg/nodes/VertexIndexDraw.h>
 
 #include <osgUtil/MeshOptimizers>
-#include <osgUtil/TangentSpaceGenerator>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
 
 namespace osg2vsg
 {
 
-    vsg::ref_ptr<vsg::vec2Array> convertToVsg(const osg::Vec2Array* inarray, uint32_t bindOverallPaddingCount)
+    namespace
     {
-        if (!inarray) return vsg::ref_ptr<vsg::vec2Array>();
-
-        uint32_t count = inarray->size();
-        uint32_t targetSize = std::max(count, bindOverallPaddingCount);
+        int16_t floatToSnorm16(float value)
+        {
+            return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        }
 
-        vsg::ref_ptr<vsg::vec2Array> outarray(new vsg::vec2Array(targetSize));
-        uint32_t i=0;
-        for(; i<count; ++i)
+        uint8_t floatToUnorm8(float value)
         {
-            const osg::Vec2& in_value = inarray->at(i);
-            outarray->at(i) = vsg::vec2(in_value.x(), in_value.y());
+            return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
         }
 
-        if (i<bindOverallPaddingCount)
+        // IEEE 754 single to half precision, rounding to nearest
+        uint16_t floatToHalf(float value)
         {
-            auto last = outarray->at(count-1);
-            for(; i<bindOverallPaddingCount; ++i)
+            uint32_t f;
+            std::memcpy(&f, &value, sizeof(f));
+
+            uint32_t sign = (f >> 16) & 0x8000;
+            uint32_t biasedExponent = (f >> 23) & 0xff;
+            uint32_t mantissa = f & 0x007fffff;
+
+            // infinity and NaN
+            if (biasedExponent == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+            int32_t exponent = static_cast<int32_t>(biasedExponent) - 127 + 15;
+
+            // overflow to infinity
+            if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+
+            // subnormal half or underflow to zero
+            if (exponent <= 0)
             {
-                outarray->at(i) = last;
+                if (exponent < -10) return static_cast<uint16_t>(sign);
+
+                mantissa |= 0x00800000;
+                uint32_t shift = static_cast<uint32_t>(14 - exponent);
+                uint32_t halfMantissa = mantissa >> shift;
+                if ((mantissa >> (shift - 1)) & 1) ++halfMantissa;
+                return static_cast<uint16_t>(sign | halfMantissa);
             }
-        }
 
-        return outarray;
+            // a carry out of the mantissa when rounding correctly bumps the exponent
+            uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+            if (mantissa & 0x00001000) ++half;
+            return static_cast<uint16_t>(half);
+        }
     }
 
-    vsg::ref_ptr<vsg::vec3Array> convertToVsg(const osg::Vec3Array* inarray, uint32_t bindOverallPaddingCount)
+    vsg::ref_ptr<vsg::svec2Array> quantizeNormals(const vsg::vec3Array* normals)
     {
-        if (!inarray || inarray->size()==0) return vsg::ref_ptr<vsg::vec3Array>();
+        if (!normals) return {};
 
-        uint32_t count = inarray->size();
-        uint32_t targetSize = std::max(count, bindOverallPaddingCount);
-
-        vsg::ref_ptr<vsg::vec3Array> outarray(new vsg::vec3Array(targetSize));
-        uint32_t i=0;
-        for(; i<count; ++i)
+        auto quantized = vsg::svec2Array::create(normals->valueCount());
+        for(uint32_t i = 0; i < normals->valueCount(); ++i)
         {
-            const osg::Vec3& in_value = inarray->at(i);
-            outarray->at(i) = vsg::vec3(in_value.x(), in_value.y(), in_value.z());
-        }
+            const vsg::vec3& n = normals->at(i);
 
-        if (i<bindOverallPaddingCount)
-        {
-            auto last = outarray->at(count-1);
-            for(; i<bindOverallPaddingCount; ++i)
+            // project onto the octahedron, then fold the lower hemisphere over the upper one
+            float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+            float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+            float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+            if (n.z < 0.0f)
             {
-                outarray->at(i) = last;
+                float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
             }
-        }
 
-        return outarray;
+            quantized->at(i) = vsg::svec2(floatToSnorm16(x), floatToSnorm16(y));
+        }
+        return quantized;
     }
 
-    vsg::ref_ptr<vsg::vec4Array> convertToVsg(const osg::Vec4Array* inarray, uint32_t bindOverallPaddingCount)
+    vsg::ref_ptr<vsg::svec4Array> quantizeTangents(const vsg::vec4Array* tangents)
     {
-        if (!inarray) return vsg::ref_ptr<vsg::vec4Array>();
-
-        uint32_t count = inarray->size();
-        uint32_t targetSize = std::max(count, bindOverallPaddingCount);
+        if (!tangents) return {};
 
-        vsg::ref_ptr<vsg::vec4Array> outarray(new vsg::vec4Array(targetSize));
-        uint32_t i=0;
-        for(; i<count; ++i)
+        auto quantized = vsg::svec4Array::create(tangents->valueCount());
+        for(uint32_t i = 0; i < tangents->valueCount(); ++i)
         {
-            const osg::Vec4& in_value = inarray->at(i);
-            outarray->at(i) = vsg::vec4(in_value.x(), in_value.y(), in_value.z(), in_value.w());
+            const vsg::vec4& t = tangents->at(i);
+            quantized->at(i) = vsg::svec4(floatToSnorm16(t.x), floatToSnorm16(t.y), floatToSnorm16(t.z), floatToSnorm16(t.w));
         }
+        return quantized;
+    }
+
+    vsg::ref_ptr<vsg::ubvec4Array> quantizeColors(const vsg::vec4Array* colors)
+    {
+        if (!colors) return {};
 
-        if (i<bindOverallPaddingCount)
+        auto quantized = vsg::ubvec4Array::create(colors->valueCount());
+        for(uint32_t i = 0; i < colors->valueCount(); ++i)
         {
-            auto last = outarray->at(count-1);
-            for(; i<bindOverallPaddingCount; ++i)
-            {
-                outarray->at(i) = last;
-            }
+            const vsg::vec4& c = colors->at(i);
+            quantized->at(i) = vsg::ubvec4(floatToUnorm8(c.r), floatToUnorm8(c.g), floatToUnorm8(c.b), floatToUnorm8(c.a));
         }
-
-        return outarray;
+        return quantized;
     }
 
-    vsg::ref_ptr<vsg::Data> convertToVsg(const osg::Array* inarray, uint32_t bindOverallPaddingCount)
+    vsg::ref_ptr<vsg::usvec2Array> quantizeTexCoords(const vsg::vec2Array* texcoords)
     {
-        if (!inarray) return vsg::ref_ptr<vsg::Data>();
+        if (!texcoords) return {};
 
-        switch (inarray->getType())
+        auto quantized = vsg::usvec2Array::create(texcoords->valueCount());
+        for(uint32_t i = 0; i < texcoords->valueCount(); ++i)
         {
-            case osg::Array::Type::Vec2ArrayType: return convertToVsg(dynamic_cast<const osg::Vec2Array*>(inarray), bindOverallPaddingCount);
-            case osg::Array::Type::Vec3ArrayType: return convertToVsg(dynamic_cast<const osg::Vec3Array*>(inarray), bindOverallPaddingCount);
-            case osg::Array::Type::Vec4ArrayType: return convertToVsg(dynamic_cast<const osg::Vec4Array*>(inarray), bindOverallPaddingCount);
-            default: return vsg::ref_ptr<vsg::Data>();
+            const vsg::vec2& tc = texcoords->at(i);
+            quantized->at(i) = vsg::usvec2(floatToHalf(tc.x), floatToHalf(tc.y));
         }
+        return quantized;
+    }
+
+    void GeometryStats::print(std::ostream& out) const
+    {
+        out<<"GeometryStats : converted "<<numVertexIndexDraws<<" VertexIndexDraw (single draw), "<<numGeometries<<" Geometry ("
+           <<numGeometriesWithMultipleDraws<<" with multiple draws, "<<numGeometriesWithoutIndices<<" without indices), "<<numCommands<<" Commands"<<std::endl;
+        if (numVertexIndexDrawFallbacks > 0) out<<"    "<<numVertexIndexDrawFallbacks<<" geometries requested as VertexIndexDraw fell back to Geometry as they need multiple draws"<<std::endl;
+        if (numGeometriesWelded > 0) out<<"    welded "<<numGeometriesWelded<<" geometries, "<<numVerticesBeforeWeld<<" vertices reduced to "<<numVerticesAfterWeld<<std::endl;
     }
 
     uint32_t calculateAttributesMask(const osg::Geometry* geometry)
@@ -136,22 +172,84 @@ namespace osg2vsg
             if ( geometry->getVertexAttribBinding(7) == osg::Geometry::AttributeBinding::BIND_OVERALL) mask |= TRANSLATE_OVERALL;
         }
 
+        if (geometry->getVertexAttribArray(BONE_INDICES_CHANNEL) != nullptr && geometry->getVertexAttribArray(BONE_WEIGHTS_CHANNEL) != nullptr) mask |= BONES;
+
         if (geometry->getTexCoordArray(0) != nullptr) mask |= TEXCOORD0;
         if (geometry->getTexCoordArray(1) != nullptr) mask |= TEXCOORD1;
         if (geometry->getTexCoordArray(2) != nullptr) mask |= TEXCOORD2;
         return mask;
     }
 
+    VertexAttributes computeVertexAttributes(uint32_t geometryAttributesMask)
+    {
+        VertexAttributes attributes;
+
+        // attributes bound overall hold a single value shared by every vertex and instance, so rather than padding them out to the vertex or
+        // instance count they're bound with a stride of 0
+        auto add = [&](uint32_t location, VkFormat format, uint32_t size, uint32_t overallMask)
+        {
+            if (geometryAttributesMask & overallMask) attributes.push_back(VertexAttribute{location, format, size, VK_VERTEX_INPUT_RATE_INSTANCE, 0});
+            else attributes.push_back(VertexAttribute{location, format, size, VK_VERTEX_INPUT_RATE_VERTEX, size});
+        };
+
+        // always have vertices
+        add(VERTEX_CHANNEL, VK_FORMAT_R32G32B32_SFLOAT, sizeof(vsg::vec3), 0);
+
+        if (geometryAttributesMask & QUANTIZED)
+        {
+            if (geometryAttributesMask & NORMAL) add(NORMAL_CHANNEL, VK_FORMAT_R16G16_SNORM, sizeof(vsg::svec2), NORMAL_OVERALL); // octahedral normal as svec2
+            if (geometryAttributesMask & TANGENT) add(TANGENT_CHANNEL, VK_FORMAT_R16G16B16A16_SNORM, sizeof(vsg::svec4), TANGENT_OVERALL); // tangent as svec4
+            if (geometryAttributesMask & COLOR) add(COLOR_CHANNEL, VK_FORMAT_R8G8B8A8_UNORM, sizeof(vsg::ubvec4), COLOR_OVERALL); // color as ubvec4
+            if (geometryAttributesMask & TEXCOORD0) add(TEXCOORD0_CHANNEL, VK_FORMAT_R16G16_SFLOAT, sizeof(vsg::usvec2), 0); // texcoord as half floats
+        }
+        else
+        {
+            if (geometryAttributesMask & NORMAL) add(NORMAL_CHANNEL, VK_FORMAT_R32G32B32_SFLOAT, sizeof(vsg::vec3), NORMAL_OVERALL); // normal as vec3
+            if (geometryAttributesMask & TANGENT) add(TANGENT_CHANNEL, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(vsg::vec4), TANGENT_OVERALL); // tangent as vec4
+            if (geometryAttributesMask & COLOR) add(COLOR_CHANNEL, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(vsg::vec4), COLOR_OVERALL); // color as vec4
+            if (geometryAttributesMask & TEXCOORD0) add(TEXCOORD0_CHANNEL, VK_FORMAT_R32G32_SFLOAT, sizeof(vsg::vec2), 0); // texcoord as vec2
+        }
+
+        // translations bound overall hold one value per instance, as used for our custom osg::Billboard handling
+        if (geometryAttributesMask & TRANSLATE)
+        {
+            auto rate = (geometryAttributesMask & TRANSLATE_OVERALL) ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
+            attributes.push_back(VertexAttribute{TRANSLATE_CHANNEL, VK_FORMAT_R32G32B32_SFLOAT, sizeof(vsg::vec3), rate, sizeof(vsg::vec3)}); // translate as vec3
+        }
+
+        if (geometryAttributesMask & INSTANCE_MATRIX)
+        {
+            // mat4 as four vec4 columns
+            for(uint32_t column = 0; column < 4; ++column)
+            {
+                attributes.push_back(VertexAttribute{INSTANCE_MATRIX_CHANNEL + column, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(vsg::vec4), VK_VERTEX_INPUT_RATE_INSTANCE, sizeof(vsg::vec4)});
+            }
+        }
+
+        if (geometryAttributesMask & BONES)
+        {
+            add(BONE_INDICES_CHANNEL, VK_FORMAT_R8G8B8A8_UINT, sizeof(vsg::ubvec4), 0); // four indices into the bone palette as ubvec4
+            if (geometryAttributesMask & QUANTIZED) add(BONE_WEIGHTS_CHANNEL, VK_FORMAT_R8G8B8A8_UNORM, sizeof(vsg::ubvec4), 0); // weights as ubvec4
+            else add(BONE_WEIGHTS_CHANNEL, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(vsg::vec4), 0); // weights as vec4
+        }
+
+        return attributes;
+    }
+
     VkPrimitiveTopology convertToTopology(osg::PrimitiveSet::Mode primitiveMode)
     {
+        // triangle strips, fans and the legacy quad and polygon modes are expanded into triangle lists by convertToVsg(osg::Geometry*)
         switch (primitiveMode)
         {
             case osg::PrimitiveSet::Mode::POINTS: return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
             case osg::PrimitiveSet::Mode::LINES: return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
             case osg::PrimitiveSet::Mode::LINE_STRIP: return VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
-            case osg::PrimitiveSet::Mode::TRIANGLES: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-            case osg::PrimitiveSet::Mode::TRIANGLE_STRIP: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-            case osg::PrimitiveSet::Mode::TRIANGLE_FAN: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN;
+            case osg::PrimitiveSet::Mode::TRIANGLES:
+            case osg::PrimitiveSet::Mode::TRIANGLE_STRIP:
+            case osg::PrimitiveSet::Mode::TRIANGLE_FAN:
+            case osg::PrimitiveSet::Mode::QUADS:
+            case osg::PrimitiveSet::Mode::QUAD_STRIP:
+            case osg::PrimitiveSet::Mode::POLYGON: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
             case osg::PrimitiveSet::Mode::LINES_ADJACENCY: return VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY;
             case osg::PrimitiveSet::Mode::LINE_STRIP_ADJACENCY: return VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY;
             case osg::PrimitiveSet::Mode::TRIANGLES_ADJACENCY: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY;
@@ -160,9 +258,6 @@ namespace osg2vsg
 
             //not supported
             case osg::PrimitiveSet::Mode::LINE_LOOP:
-            case osg::PrimitiveSet::Mode::QUADS:
-            case osg::PrimitiveSet::Mode::QUAD_STRIP:
-            case osg::PrimitiveSet::Mode::POLYGON:
             default: return VK_PRIMITIVE_TOPOLOGY_MAX_ENUM; // use as unsupported flag`
         }
     }
@@ -273,112 +368,850 @@ namespace osg2vsg
         return matvalue;
     }
 
-    vsg::ref_ptr<vsg::Command> convertToVsg(osg::Geometry* ingeometry, uint32_t requiredAttributesMask, GeometryTarget geometryTarget)
+    namespace
     {
-        uint32_t instanceCount = 1;
+        struct IndexRange
+        {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            int32_t vertexOffset;
+        };
+
+        using IndexRanges = std::vector<IndexRange>;
+
+        // number of indices per primitive for the list modes whose primitives can be drawn independently of each other, 0 for all other modes
+        uint32_t numIndicesPerPrimitive(GLenum mode)
+        {
+            switch(mode)
+            {
+                case(GL_POINTS): return 1;
+                case(GL_LINES): return 2;
+                case(GL_TRIANGLES): return 3;
+                default: return 0;
+            }
+        }
+
+        // split the indices into consecutive ranges, each spanning no more than 65536 vertices so that the indices can be
+        // stored as 16 bit values relative to the range's vertexOffset. Returns false if the indices can't be split.
+        bool splitIndices(const std::vector<uint32_t>& indices, uint32_t primitiveSize, IndexRanges& ranges)
+        {
+            if (primitiveSize == 0 || (indices.size() % primitiveSize) != 0) return false;
+
+            const uint32_t maxSpan = std::numeric_limits<uint16_t>::max();
+
+            IndexRange range{0, 0, 0};
+            uint32_t rangeMin = std::numeric_limits<uint32_t>::max();
+            uint32_t rangeMax = 0;
+
+            for(size_t i = 0; i < indices.size(); i += primitiveSize)
+            {
+                auto primitiveBegin = indices.begin() + i;
+                auto primitiveEnd = primitiveBegin + primitiveSize;
+                uint32_t primitiveMin = *std::min_element(primitiveBegin, primitiveEnd);
+                uint32_t primitiveMax = *std::max_element(primitiveBegin, primitiveEnd);
+
+                // a single primitive spanning too many vertices can't be addressed with 16 bit indices
+                if ((primitiveMax - primitiveMin) > maxSpan) return false;
+
+                uint32_t newMin = std::min(rangeMin, primitiveMin);
+                uint32_t newMax = std::max(rangeMax, primitiveMax);
+                if (range.indexCount > 0 && (newMax - newMin) > maxSpan)
+                {
+                    range.vertexOffset = static_cast<int32_t>(rangeMin);
+                    ranges.push_back(range);
+
+                    range = IndexRange{static_cast<uint32_t>(i), 0, 0};
+                    newMin = primitiveMin;
+                    newMax = primitiveMax;
+                }
+
+                rangeMin = newMin;
+                rangeMax = newMax;
+                range.indexCount += primitiveSize;
+            }
+
+            if (range.indexCount > 0)
+            {
+                range.vertexOffset = static_cast<int32_t>(rangeMin);
+                ranges.push_back(range);
+            }
+
+            return true;
+        }
+
+        using IndexRun = std::pair<GLenum, std::vector<uint32_t>>;
+        using IndexRuns = std::vector<IndexRun>;
+
+        std::vector<uint32_t>& getOrCreateIndexRun(IndexRuns& runs, GLenum mode)
+        {
+            for(auto& run : runs)
+            {
+                if (run.first == mode) return run.second;
+            }
+            runs.emplace_back(mode, std::vector<uint32_t>());
+            return runs.back().second;
+        }
+
+        // the list mode that primitives of mode are expanded into, point, line, adjacency and patch modes are kept as they are
+        GLenum convertToListMode(GLenum mode)
+        {
+            switch(mode)
+            {
+                case(GL_TRIANGLES):
+                case(GL_TRIANGLE_STRIP):
+                case(GL_TRIANGLE_FAN):
+                case(GL_QUADS):
+                case(GL_QUAD_STRIP):
+                case(GL_POLYGON): return GL_TRIANGLES;
+                default: return mode;
+            }
+        }
+
+        // append the list primitives for the vertex sequence of a primitive of mode, preserving the winding of the source primitives
+        void expandPrimitives(GLenum mode, const std::vector<uint32_t>& s, std::vector<uint32_t>& indices)
+        {
+            size_t n = s.size();
+            auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c)
+            {
+                // skip the degenerate triangles that are used to stitch strips together
+                if (a == b || b == c || a == c) return;
+                indices.push_back(a); indices.push_back(b); indices.push_back(c);
+            };
+
+            switch(mode)
+            {
+                case(GL_TRIANGLE_STRIP):
+                    for(size_t i = 2; i < n; ++i)
+                    {
+                        if ((i % 2) == 0) addTriangle(s[i-2], s[i-1], s[i]);
+                        else addTriangle(s[i-1], s[i-2], s[i]);
+                    }
+                    break;
+                case(GL_TRIANGLE_FAN):
+                case(GL_POLYGON):
+                    for(size_t i = 2; i < n; ++i) addTriangle(s[0], s[i-1], s[i]);
+                    break;
+                case(GL_QUADS):
+                    for(size_t i = 3; i < n; i += 4)
+                    {
+                        addTriangle(s[i-3], s[i-2], s[i-1]);
+                        addTriangle(s[i-3], s[i-1], s[i]);
+                    }
+                    break;
+                case(GL_QUAD_STRIP):
+                    for(size_t i = 3; i < n; i += 2)
+                    {
+                        addTriangle(s[i-3], s[i-2], s[i]);
+                        addTriangle(s[i-3], s[i], s[i-1]);
+                    }
+                    break;
+                default:
+                    indices.insert(indices.end(), s.begin(), s.end());
+                    break;
+            }
+        }
 
-        // work out if we need to enable instance by looking at BIND_OVERALL entries
+        // expand every primitive set into list primitives, appending them to the run of indices for their list mode,
+        // runs left empty, such as by primitive sets with too few vertices to form a primitive, are removed
+        IndexRuns expandPrimitiveSets(const osg::Geometry* geometry)
+        {
+            IndexRuns indexRuns;
+            const osg::Geometry::PrimitiveSetList& primitiveSets = geometry->getPrimitiveSetList();
+            for (auto& primitiveSet : primitiveSets)
+            {
+                GLenum mode = primitiveSet->getMode();
+                std::vector<uint32_t>& runIndices = getOrCreateIndexRun(indexRuns, convertToListMode(mode));
+
+                std::vector<uint32_t> sequence;
+                if (osg::DrawElements* de = primitiveSet->getDrawElements())
+                {
+                    auto numindcies = de->getNumIndices();
+                    sequence.reserve(numindcies);
+                    for (unsigned int i = 0; i < numindcies; i++)
+                    {
+                        sequence.push_back(de->index(i));
+                    }
+                    expandPrimitives(mode, sequence, runIndices);
+                }
+                else if (auto da = dynamic_cast<const osg::DrawArrays*>(primitiveSet.get()))
+                {
+                    sequence.resize(da->getCount());
+                    for (uint32_t i = 0; i < sequence.size(); ++i) sequence[i] = da->getFirst() + i;
+                    expandPrimitives(mode, sequence, runIndices);
+                }
+                else if (auto dal = dynamic_cast<const osg::DrawArrayLengths*>(primitiveSet.get()))
+                {
+                    // each length is a separate primitive of the set's mode
+                    uint32_t first = dal->getFirst();
+                    for (auto length : *dal)
+                    {
+                        sequence.resize(length);
+                        for (uint32_t i = 0; i < sequence.size(); ++i) sequence[i] = first + i;
+                        expandPrimitives(mode, sequence, runIndices);
+                        first += length;
+                    }
+                }
+            }
+
+            indexRuns.erase(std::remove_if(indexRuns.begin(), indexRuns.end(), [](const IndexRun& run) { return run.second.empty(); }), indexRuns.end());
+
+            return indexRuns;
+        }
+
+        // split each run of list primitives into 16 bit addressable ranges, returns false if any run can't be split
+        bool splitIndexRuns(const IndexRuns& runs, IndexRanges& ranges)
+        {
+            uint32_t firstIndex = 0;
+            for(auto& run : runs)
+            {
+                IndexRanges runRanges;
+                if (!splitIndices(run.second, numIndicesPerPrimitive(run.first), runRanges))
+                {
+                    ranges.clear();
+                    return false;
+                }
+
+                for(auto& range : runRanges)
+                {
+                    range.firstIndex += firstIndex;
+                    ranges.push_back(range);
+                }
+                firstIndex += static_cast<uint32_t>(run.second.size());
+            }
+            return true;
+        }
+
+        // work out if we need to enable instance by looking at the BIND_OVERALL translations and instance matrices
         // to see if any have more than one element which we'll interpret requesting instancing, such as used for our custom osg::Billboard handling.
+        // The other BIND_OVERALL arrays hold a single value bound with a stride of 0, see computeVertexAttributes(), so need no padding.
+        uint32_t computeInstanceCount(const osg::Geometry* geometry, uint32_t requiredAttributesMask)
+        {
+            uint32_t instanceCount = 1;
+
+            std::vector<uint32_t> perInstanceAttribs{7};
+            if (requiredAttributesMask & INSTANCE_MATRIX)
+            {
+                for(uint32_t column = 0; column < 4; ++column) perInstanceAttribs.push_back(INSTANCE_MATRIX_CHANNEL + column);
+            }
+
+            for(auto index : perInstanceAttribs)
+            {
+                auto array = geometry->getVertexAttribArray(index);
+                if (array && array->getBinding()==osg::Array::BIND_OVERALL)
+                {
+                    if (instanceCount < array->getNumElements()) instanceCount = array->getNumElements();
+                }
+            }
+
+            return instanceCount;
+        }
+
+        // number of triangles drawn by convertToVsg(), once the triangle primitive sets have been expanded into lists
+        size_t computeNumTriangles(const osg::Geometry* geometry)
+        {
+            size_t numTriangles = 0;
+            for(auto& run : expandPrimitiveSets(geometry))
+            {
+                if (run.first == GL_TRIANGLES) numTriangles += run.second.size() / 3;
+            }
+            return numTriangles;
+        }
+
+        // value used for vertices when an interleaved attribute has no source array
+        void writeDefaultAttributeValue(const VertexAttribute& attribute, uint8_t* dest)
+        {
+            std::memset(dest, 0, attribute.size);
+            if (attribute.format == VK_FORMAT_R32G32B32A32_SFLOAT && attribute.location == COLOR_CHANNEL)
+            {
+                vsg::vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+                std::memcpy(dest, &white, sizeof(white));
+            }
+            else if (attribute.format == VK_FORMAT_R8G8B8A8_UNORM && attribute.location == COLOR_CHANNEL)
+            {
+                std::memset(dest, 255, attribute.size);
+            }
+            else if (attribute.format == VK_FORMAT_R32G32B32_SFLOAT && attribute.location == NORMAL_CHANNEL)
+            {
+                vsg::vec3 up(0.0f, 0.0f, 1.0f);
+                std::memcpy(dest, &up, sizeof(up));
+            }
+        }
+
+        // pack the per vertex attributes into a single array, with one row of width stride per vertex
+        vsg::ref_ptr<vsg::Data> interleaveArrays(const VertexAttributes& attributes, const std::map<uint32_t, vsg::ref_ptr<vsg::Data>>& locationArrays, uint32_t vertexCount)
         {
-            osg::Geometry::ArrayList arrays;
-            if (ingeometry->getArrayList(arrays))
+            uint32_t stride = 0;
+            for(auto& attribute : attributes) stride += attribute.size;
+
+            auto interleaved = vsg::ubyteArray2D::create(stride, vertexCount);
+            uint8_t* dest = static_cast<uint8_t*>(interleaved->dataPointer());
+
+            uint32_t offset = 0;
+            for(auto& attribute : attributes)
             {
-                for(auto& array : arrays)
+                const uint8_t* src = nullptr;
+                if (auto itr = locationArrays.find(attribute.location); itr != locationArrays.end() && itr->second)
+                {
+                    auto& array = itr->second;
+                    if (array->valueSize() == attribute.size && array->valueCount() >= vertexCount) src = static_cast<const uint8_t*>(array->dataPointer());
+                }
+
+                if (src)
+                {
+                    for(uint32_t i = 0; i < vertexCount; ++i)
+                    {
+                        std::memcpy(dest + i * stride + offset, src + i * attribute.size, attribute.size);
+                    }
+                }
+                else
                 {
-                    if (array->getBinding()==osg::Array::BIND_OVERALL)
+                    for(uint32_t i = 0; i < vertexCount; ++i)
                     {
-                        if (instanceCount < array->getNumElements()) instanceCount = array->getNumElements();
+                        writeDefaultAttributeValue(attribute, dest + i * stride + offset);
                     }
                 }
+
+                offset += attribute.size;
             }
 
+            return interleaved;
         }
 
-        uint32_t bindOverallPaddingCount = instanceCount;
+        // copy the indices into a vsg index array, making each index relative to the vertexOffset of its range
+        template<class A>
+        vsg::ref_ptr<vsg::Data> createIndices(const std::vector<uint32_t>& indices, const IndexRanges& ranges)
+        {
+            using value_type = typename A::value_type;
 
+            auto vsgindices = A::create(static_cast<uint32_t>(indices.size()));
+            value_type* dest = static_cast<value_type*>(vsgindices->dataPointer());
+            for(auto& range : ranges)
+            {
+                for(uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; ++i)
+                {
+                    dest[i] = static_cast<value_type>(indices[i] - range.vertexOffset);
+                }
+            }
+            return vsgindices;
+        }
+    }
+
+    namespace
+    {
+        template<class A>
+        bool isPerVertexArray(const osg::Array* array, unsigned int numVertices)
+        {
+            return dynamic_cast<const A*>(array) && array->getBinding() == osg::Array::BIND_PER_VERTEX && array->getNumElements() == numVertices;
+        }
+
+        // mask of the arrays held by a geometry when all of them can be merged with other geometries, 0 if the geometry can't be merged
+        uint32_t batchableArraysMask(const osg::Geometry* geometry)
+        {
+            auto vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+            if (!vertices || vertices->empty()) return 0;
+
+            unsigned int numVertices = vertices->size();
+            uint32_t mask = VERTEX;
+
+            if (auto normals = geometry->getNormalArray())
+            {
+                if (!isPerVertexArray<osg::Vec3Array>(normals, numVertices)) return 0;
+                mask |= NORMAL;
+            }
+
+            if (auto colors = geometry->getColorArray())
+            {
+                if (!isPerVertexArray<osg::Vec4Array>(colors, numVertices)) return 0;
+                mask |= COLOR;
+            }
+
+            if (geometry->getSecondaryColorArray() || geometry->getFogCoordArray()) return 0;
+
+            for(unsigned int unit = 0; unit < geometry->getNumTexCoordArrays(); ++unit)
+            {
+                auto texcoords = geometry->getTexCoordArray(unit);
+                if (!texcoords) continue;
+                if (unit != 0 || !isPerVertexArray<osg::Vec2Array>(texcoords, numVertices)) return 0;
+                mask |= TEXCOORD0;
+            }
+
+            // only tangents may be merged, translations drive instancing
+            for(unsigned int index = 0; index < geometry->getNumVertexAttribArrays(); ++index)
+            {
+                auto attributes = geometry->getVertexAttribArray(index);
+                if (!attributes) continue;
+                if (index != 6 || !isPerVertexArray<osg::Vec4Array>(attributes, numVertices)) return 0;
+                mask |= TANGENT;
+            }
+
+            for(auto& primitiveSet : geometry->getPrimitiveSetList())
+            {
+                if (primitiveSet->getNumInstances() > 0) return 0;
+            }
+
+            return mask;
+        }
+
+        template<class A>
+        void appendArray(osg::ref_ptr<A>& merged, const osg::Array* array)
+        {
+            auto source = static_cast<const A*>(array);
+            if (!merged) merged = new A;
+            merged->insert(merged->end(), source->begin(), source->end());
+        }
+
+        osg::ref_ptr<osg::Geometry> mergeGeometries(const std::vector<osg::ref_ptr<osg::Geometry>>& geometries, uint32_t arraysMask)
+        {
+            osg::ref_ptr<osg::Vec3Array> vertices, normals;
+            osg::ref_ptr<osg::Vec4Array> colors, tangents;
+            osg::ref_ptr<osg::Vec2Array> texcoords;
+
+            osg::ref_ptr<osg::Geometry> merged = new osg::Geometry;
+            for(auto& geometry : geometries)
+            {
+                uint32_t offset = vertices ? vertices->size() : 0;
+
+                appendArray(vertices, geometry->getVertexArray());
+                if (arraysMask & NORMAL) appendArray(normals, geometry->getNormalArray());
+                if (arraysMask & COLOR) appendArray(colors, geometry->getColorArray());
+                if (arraysMask & TEXCOORD0) appendArray(texcoords, geometry->getTexCoordArray(0));
+                if (arraysMask & TANGENT) appendArray(tangents, geometry->getVertexAttribArray(6));
+
+                for(auto& primitiveSet : geometry->getPrimitiveSetList())
+                {
+                    GLenum mode = primitiveSet->getMode();
+                    if (auto de = primitiveSet->getDrawElements())
+                    {
+                        osg::ref_ptr<osg::DrawElementsUInt> elements = new osg::DrawElementsUInt(mode);
+                        elements->reserve(de->getNumIndices());
+                        for(unsigned int i = 0; i < de->getNumIndices(); ++i) elements->push_back(de->index(i) + offset);
+                        merged->addPrimitiveSet(elements);
+                    }
+                    else if (auto da = dynamic_cast<const osg::DrawArrays*>(primitiveSet.get()))
+                    {
+                        merged->addPrimitiveSet(new osg::DrawArrays(mode, da->getFirst() + offset, da->getCount()));
+                    }
+                    else if (auto dal = dynamic_cast<const osg::DrawArrayLengths*>(primitiveSet.get()))
+                    {
+                        osg::ref_ptr<osg::DrawArrayLengths> lengths = new osg::DrawArrayLengths(mode, dal->getFirst() + offset);
+                        lengths->insert(lengths->end(), dal->begin(), dal->end());
+                        merged->addPrimitiveSet(lengths);
+                    }
+                }
+            }
+
+            merged->setVertexArray(vertices);
+            if (normals) merged->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+            if (colors) merged->setColorArray(colors, osg::Array::BIND_PER_VERTEX);
+            if (texcoords) merged->setTexCoordArray(0, texcoords, osg::Array::BIND_PER_VERTEX);
+            if (tangents) merged->setVertexAttribArray(6, tangents, osg::Array::BIND_PER_VERTEX);
+
+            return merged;
+        }
+    }
+
+    std::vector<osg::ref_ptr<osg::Geometry>> batchGeometries(const std::vector<osg::ref_ptr<osg::Geometry>>& geometries, double cellSize, uint32_t maxVertices)
+    {
+        if (geometries.size() < 2) return geometries;
+
+        if (cellSize <= 0.0)
+        {
+            osg::BoundingBox bb;
+            for(auto& geometry : geometries) bb.expandBy(geometry->getBoundingBox());
+
+            double longestAxis = std::max({bb.xMax() - bb.xMin(), bb.yMax() - bb.yMin(), bb.zMax() - bb.zMin()});
+            cellSize = longestAxis > 0.0 ? longestAxis / 4.0 : 1.0;
+        }
+
+        struct Batch
+        {
+            std::vector<osg::ref_ptr<osg::Geometry>> geometries;
+            uint32_t numVertices = 0;
+        };
+
+        // geometries are only merged with ones holding the same arrays and whose centers fall in the same cell
+        using CellKey = std::tuple<uint32_t, int64_t, int64_t, int64_t>;
+        std::map<CellKey, std::vector<Batch>> cellBatches;
+
+        std::vector<osg::ref_ptr<osg::Geometry>> batched;
+        for(auto& geometry : geometries)
+        {
+            // geometries used elsewhere in the scene are left to be shared rather than copied into batches
+            uint32_t arraysMask = geometry->getNumParents() <= 1 ? batchableArraysMask(geometry) : 0;
+            uint32_t numVertices = arraysMask ? geometry->getVertexArray()->getNumElements() : 0;
+            if (arraysMask == 0 || numVertices > maxVertices)
+            {
+                batched.push_back(geometry);
+                continue;
+            }
+
+            osg::Vec3 center = geometry->getBoundingBox().center();
+            CellKey key(arraysMask, static_cast<int64_t>(std::floor(center.x() / cellSize)), static_cast<int64_t>(std::floor(center.y() / cellSize)), static_cast<int64_t>(std::floor(center.z() / cellSize)));
+
+            auto& batches = cellBatches[key];
+            if (batches.empty() || (batches.back().numVertices + numVertices) > maxVertices) batches.emplace_back();
+
+            batches.back().geometries.push_back(geometry);
+            batches.back().numVertices += numVertices;
+        }
+
+        for(auto& [key, batches] : cellBatches)
+        {
+            for(auto& batch : batches)
+            {
+                if (batch.geometries.size() == 1) batched.push_back(batch.geometries.front());
+                else batched.push_back(mergeGeometries(batch.geometries, std::get<0>(key)));
+            }
+        }
+
+        return batched;
+    }
+
+    vsg::ref_ptr<vsg::vec4Array> generateTangents(const osg::Geometry* geometry)
+    {
+        std::vector<osg::Vec3> positions;
+        if (auto vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()))
+        {
+            positions.assign(vertices->begin(), vertices->end());
+        }
+        else if (auto dvertices = dynamic_cast<const osg::Vec3dArray*>(geometry->getVertexArray()))
+        {
+            for(auto& v : *dvertices) positions.emplace_back(v);
+        }
+
+        auto texcoords = dynamic_cast<const osg::Vec2Array*>(geometry->getTexCoordArray(0));
+        if (positions.empty() || !texcoords || texcoords->size() < positions.size()) return {};
+
+        std::vector<uint32_t> triangles;
+        for(auto& run : expandPrimitiveSets(geometry))
+        {
+            if (run.first == GL_TRIANGLES) triangles.insert(triangles.end(), run.second.begin(), run.second.end());
+        }
+        if (triangles.empty()) return {};
+
+        uint32_t numVertices = static_cast<uint32_t>(positions.size());
+        for(auto index : triangles)
+        {
+            if (index >= numVertices) return {};
+        }
+
+        // use the per vertex normals, or the area weighted face normals where there aren't any
+        std::vector<osg::Vec3> normals(numVertices);
+        auto vertexNormals = dynamic_cast<const osg::Vec3Array*>(geometry->getNormalArray());
+        if (vertexNormals && vertexNormals->getBinding() == osg::Array::BIND_PER_VERTEX && vertexNormals->size() >= numVertices)
+        {
+            std::copy(vertexNormals->begin(), vertexNormals->begin() + numVertices, normals.begin());
+        }
+        else
+        {
+            for(size_t i = 0; i + 2 < triangles.size(); i += 3)
+            {
+                osg::Vec3 normal = (positions[triangles[i + 1]] - positions[triangles[i]]) ^ (positions[triangles[i + 2]] - positions[triangles[i]]);
+                for(size_t c = 0; c < 3; ++c) normals[triangles[i + c]] += normal;
+            }
+        }
+        for(auto& normal : normals) normal.normalize();
+
+        // accumulate the texture space directions of each triangle at its corners, projected into the vertex's tangent plane and weighted
+        // by the angle of the triangle at the corner as MikkTSpace does, so the result doesn't depend on how the faces are tessellated
+        std::vector<osg::Vec3> tangentSums(numVertices);
+        std::vector<osg::Vec3> bitangentSums(numVertices);
+        for(size_t i = 0; i + 2 < triangles.size(); i += 3)
+        {
+            uint32_t v[3] = {triangles[i], triangles[i + 1], triangles[i + 2]};
+
+            osg::Vec3 e1 = positions[v[1]] - positions[v[0]];
+            osg::Vec3 e2 = positions[v[2]] - positions[v[0]];
+            osg::Vec2 duv1 = (*texcoords)[v[1]] - (*texcoords)[v[0]];
+            osg::Vec2 duv2 = (*texcoords)[v[2]] - (*texcoords)[v[0]];
+
+            float determinant = duv1.x() * duv2.y() - duv2.x() * duv1.y();
+            if (determinant == 0.0f) continue;
+
+            // only the direction matters, so scale by the determinant's sign rather than dividing by it
+            float orientation = determinant > 0.0f ? 1.0f : -1.0f;
+            osg::Vec3 faceTangent = (e1 * duv2.y() - e2 * duv1.y()) * orientation;
+            osg::Vec3 faceBitangent = (e2 * duv1.x() - e1 * duv2.x()) * orientation;
+
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                osg::Vec3 edge0 = positions[v[(c + 1) % 3]] - positions[v[c]];
+                osg::Vec3 edge1 = positions[v[(c + 2) % 3]] - positions[v[c]];
+                if (edge0.normalize() == 0.0f || edge1.normalize() == 0.0f) continue;
+
+                float angle = std::acos(std::clamp(edge0 * edge1, -1.0f, 1.0f));
+
+                const osg::Vec3& n = normals[v[c]];
+                osg::Vec3 tangent = faceTangent - n * (n * faceTangent);
+                osg::Vec3 bitangent = faceBitangent - n * (n * faceBitangent);
+                tangent.normalize();
+                bitangent.normalize();
+
+                tangentSums[v[c]] += tangent * angle;
+                bitangentSums[v[c]] += bitangent * angle;
+            }
+        }
+
+        auto tangents = vsg::vec4Array::create(numVertices);
+        for(uint32_t i = 0; i < numVertices; ++i)
+        {
+            const osg::Vec3& n = normals[i];
+            osg::Vec3 tangent = tangentSums[i] - n * (n * tangentSums[i]);
+            if (tangent.normalize() == 0.0f)
+            {
+                // no texture space direction at this vertex, so any direction perpendicular to the normal will do
+                tangent = n ^ (std::abs(n.x()) < 0.9f ? osg::Vec3(1.0f, 0.0f, 0.0f) : osg::Vec3(0.0f, 1.0f, 0.0f));
+                tangent.normalize();
+            }
+
+            float handedness = ((n ^ tangent) * bitangentSums[i]) < 0.0f ? -1.0f : 1.0f;
+            tangents->at(i) = vsg::vec4(tangent.x(), tangent.y(), tangent.z(), handedness);
+        }
+
+        return tangents;
+    }
+
+    vsg::ref_ptr<vsg::Command> convertToVsg(osg::Geometry* ingeometry, uint32_t requiredAttributesMask, GeometryTarget geometryTarget, const GeometryOptions& geometryOptions)
+    {
+        uint32_t instanceCount = computeInstanceCount(ingeometry, requiredAttributesMask);
+
+        // convert an osg::Array to the float array, or to the compact format the QUANTIZED pipeline expects, see computeVertexAttributes(),
+        // padding only the per instance arrays out to the instance count, and sharing the conversion through the array cache with the other
+        // geometries that use the same osg::Array
+        auto convertArray = [&](const osg::Array* array, VkFormat format = VK_FORMAT_UNDEFINED, uint32_t paddingCount = 0) -> vsg::ref_ptr<vsg::Data>
+        {
+            auto convert = [&]() -> vsg::ref_ptr<vsg::Data>
+            {
+                vsg::ref_ptr<vsg::Data> data(osg2vsg::convertToVsg(array, paddingCount));
+                switch(format)
+                {
+                    case(VK_FORMAT_R16G16_SNORM): if (auto normals = dynamic_cast<vsg::vec3Array*>(data.get())) return quantizeNormals(normals); break;
+                    case(VK_FORMAT_R16G16B16A16_SNORM): if (auto tangents = dynamic_cast<vsg::vec4Array*>(data.get())) return quantizeTangents(tangents); break;
+                    case(VK_FORMAT_R8G8B8A8_UNORM): if (auto colors = dynamic_cast<vsg::vec4Array*>(data.get())) return quantizeColors(colors); break;
+                    case(VK_FORMAT_R16G16_SFLOAT): if (auto texcoords = dynamic_cast<vsg::vec2Array*>(data.get())) return quantizeTexCoords(texcoords); break;
+                    default: break;
+                }
+                return data;
+            };
+
+            // arrays only used by this geometry gain nothing from sharing, and left uncached they remain free for OptimizeMeshes to reorder
+            if (!array || !geometryOptions.arrayCache || array->referenceCount() <= 1) return convert();
+            return geometryOptions.arrayCache->getOrCreate(array, paddingCount, format, convert);
+        };
+
+        bool quantized = (requiredAttributesMask & QUANTIZED) != 0;
 
         // convert attribute arrays, create defaults for any requested that don't exist for now to ensure pipline gets required data
-        vsg::ref_ptr<vsg::Data> vertices(osg2vsg::convertToVsg(ingeometry->getVertexArray(), bindOverallPaddingCount));
+        vsg::ref_ptr<vsg::Data> vertices;
+        vsg::dvec3 origin;
+        if (computeRelativeToCenterOrigin(ingeometry, geometryOptions, origin)) vertices = osg2vsg::convertToVsg(static_cast<const osg::Vec3dArray*>(ingeometry->getVertexArray()), origin);
+        else vertices = convertArray(ingeometry->getVertexArray());
         if (!vertices.valid() || vertices->valueCount() == 0) return vsg::ref_ptr<vsg::Geometry>();
 
+        // only the arrays the pipeline has attributes for are converted, so arrays stripped from the mask aren't bound, see stripUnusedGeometryAttributes()
+
         // normals
-        vsg::ref_ptr<vsg::Data> normals(osg2vsg::convertToVsg(ingeometry->getNormalArray(), bindOverallPaddingCount));
+        vsg::ref_ptr<vsg::Data> normals;
+        if (requiredAttributesMask & NORMAL) normals = convertArray(ingeometry->getNormalArray(), quantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_UNDEFINED);
 
         // tangents
-        vsg::ref_ptr<vsg::Data> tangents(osg2vsg::convertToVsg(ingeometry->getVertexAttribArray(6), bindOverallPaddingCount));
-        if ((!tangents.valid() || tangents->valueCount() == 0) && (requiredAttributesMask & TANGENT))
+        vsg::ref_ptr<vsg::Data> tangents;
+        if (requiredAttributesMask & TANGENT)
         {
-            osg::ref_ptr<osgUtil::TangentSpaceGenerator> tangentSpaceGenerator = new osgUtil::TangentSpaceGenerator();
-            tangentSpaceGenerator->generate(ingeometry, 0);
-
-            osg::Vec4Array* tangentArray = tangentSpaceGenerator->getTangentArray();
-            //osg::Vec4Array* biNormalArray = tangGen->getBinormalArray();
-
-            if (tangentArray && tangentArray->size() > 0)
+            tangents = convertArray(ingeometry->getVertexAttribArray(6), quantized ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_UNDEFINED);
+            if (!tangents.valid() || tangents->valueCount() == 0)
             {
-                tangents = osg2vsg::convertToVsg(tangentArray, bindOverallPaddingCount);
-                // bind them to the osg geometry too??
-                ingeometry->setVertexAttribArray(6, tangentArray);
-                ingeometry->setVertexAttribBinding(6, osg::Geometry::BIND_PER_VERTEX);
+                auto generated = generateTangents(ingeometry);
+                if (quantized && generated) tangents = quantizeTangents(generated);
+                else tangents = generated;
             }
         }
 
         // colors
-        vsg::ref_ptr<vsg::Data> colors(osg2vsg::convertToVsg(ingeometry->getColorArray(), bindOverallPaddingCount));
+        vsg::ref_ptr<vsg::Data> colors;
+        if (requiredAttributesMask & COLOR) colors = convertArray(ingeometry->getColorArray(), quantized ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_UNDEFINED);
 
         // tex0
-        vsg::ref_ptr<vsg::Data> texcoord0(osg2vsg::convertToVsg(ingeometry->getTexCoordArray(0), bindOverallPaddingCount));
+        vsg::ref_ptr<vsg::Data> texcoord0;
+        if (requiredAttributesMask & TEXCOORD0) texcoord0 = convertArray(ingeometry->getTexCoordArray(0), quantized ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_UNDEFINED);
 
-        vsg::ref_ptr<vsg::Data> translations(osg2vsg::convertToVsg(ingeometry->getVertexAttribArray(7), bindOverallPaddingCount));
+        vsg::ref_ptr<vsg::Data> translations;
+        if (requiredAttributesMask & TRANSLATE) translations = convertArray(ingeometry->getVertexAttribArray(7), VK_FORMAT_UNDEFINED, (requiredAttributesMask & TRANSLATE_OVERALL) ? instanceCount : 0);
 
-        // fill arrays data list THE ORDER HERE IS IMPORTANT
-        auto attributeArrays = vsg::DataList{ vertices }; // always have verticies
-        if (normals.valid() && normals->valueCount() > 0) attributeArrays.push_back(normals);
-        if (tangents.valid() && tangents->valueCount() > 0) attributeArrays.push_back(tangents);
-        if (colors.valid() && colors->valueCount() > 0) attributeArrays.push_back(colors);
-        if (texcoord0.valid() && texcoord0->valueCount() > 0) attributeArrays.push_back(texcoord0);
-        if (translations.valid() && translations->valueCount() > 0) attributeArrays.push_back(translations);
+        vsg::DataList instanceMatrixColumns;
+        if (requiredAttributesMask & INSTANCE_MATRIX)
+        {
+            for(uint32_t column = 0; column < 4; ++column)
+            {
+                instanceMatrixColumns.push_back(convertArray(ingeometry->getVertexAttribArray(INSTANCE_MATRIX_CHANNEL + column), VK_FORMAT_UNDEFINED, instanceCount));
+            }
+        }
+
+        // the bone indices are passed through unconverted as the shader reads them as integers
+        vsg::ref_ptr<vsg::Data> boneIndices;
+        vsg::ref_ptr<vsg::Data> boneWeights;
+        if (requiredAttributesMask & BONES)
+        {
+            boneIndices = copyArray(ingeometry->getVertexAttribArray(BONE_INDICES_CHANNEL));
+            boneWeights = convertArray(ingeometry->getVertexAttribArray(BONE_WEIGHTS_CHANNEL), quantized ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_UNDEFINED);
+        }
 
         // convert indicies
 
-        // asume all the draw elements use the same primitive mode, copy all drawelements indicies into one indicie array and use in single drawindexed command
-        // create a draw command per drawarrays primitive set
+        // expand the primitive sets into list primitives so that the geometry is drawn with a single index buffer and one DrawIndexed per run
+        IndexRuns indexRuns = expandPrimitiveSets(ingeometry);
 
-        vsg::Geometry::DrawCommands drawCommands;
+        // the pipelines osg2vsg creates all draw triangle lists, so the line, point, adjacency and patch runs are left out of the batch
+        indexRuns.erase(std::remove_if(indexRuns.begin(), indexRuns.end(), [](const IndexRun& run) { return run.first != GL_TRIANGLES; }), indexRuns.end());
 
-        std::vector<uint16_t> indcies; // use to combine indicies from all drawelements
-        osg::Geometry::PrimitiveSetList& primitiveSets = ingeometry->getPrimitiveSetList();
-        for (osg::Geometry::PrimitiveSetList::const_iterator itr = primitiveSets.begin();
-            itr != primitiveSets.end();
-            ++itr)
+        // concatenate the runs, each becoming one or more index ranges
+        std::vector<uint32_t> indcies;
+        IndexRanges runRanges;
+        for(auto& run : indexRuns)
         {
-            osg::DrawElements* de = (*itr)->getDrawElements();
-            if (de)
+            runRanges.push_back(IndexRange{static_cast<uint32_t>(indcies.size()), static_cast<uint32_t>(run.second.size()), 0});
+            indcies.insert(indcies.end(), run.second.begin(), run.second.end());
+        }
+
+        // merge duplicate vertices, such as those left by de-indexed imports, across the per vertex arrays
+        vsg::DataList perVertexArrays;
+        uint32_t vertexCount = vertices.valid() ? static_cast<uint32_t>(vertices->valueCount()) : 0;
+        if (geometryOptions.weldVertices && !indcies.empty())
+        {
+            perVertexArrays.push_back(vertices);
+            if (!(requiredAttributesMask & NORMAL_OVERALL)) perVertexArrays.push_back(normals);
+            if (!(requiredAttributesMask & TANGENT_OVERALL)) perVertexArrays.push_back(tangents);
+            if (!(requiredAttributesMask & COLOR_OVERALL)) perVertexArrays.push_back(colors);
+            perVertexArrays.push_back(texcoord0);
+            if (!(requiredAttributesMask & TRANSLATE_OVERALL)) perVertexArrays.push_back(translations);
+            perVertexArrays.push_back(boneIndices);
+            perVertexArrays.push_back(boneWeights);
+        }
+
+        // a per vertex array whose length doesn't match the vertex array can't follow the renumbering, so the geometry is left unwelded
+        bool perVertexCountsMatch = std::all_of(perVertexArrays.begin(), perVertexArrays.end(), [vertexCount](const vsg::ref_ptr<vsg::Data>& array) { return !array || array->valueCount() == vertexCount; });
+
+        if (!perVertexArrays.empty() && perVertexCountsMatch)
+        {
+            uint32_t weldedCount = weldVertices(indcies, perVertexArrays, vertexCount, geometryOptions.weldTolerance);
+
+            // the welded vertices are compacted so the runs each still index from the start of the arrays
+            size_t offset = 0;
+            for(auto& run : indexRuns)
             {
-                // merge indicies
-                auto numindcies = de->getNumIndices();
-                for (unsigned int i = 0; i < numindcies; i++)
-                {
-                    indcies.push_back(de->index(i));
-                }
+                std::copy(indcies.begin() + offset, indcies.begin() + offset + run.second.size(), run.second.begin());
+                offset += run.second.size();
             }
-            else
+
+            size_t a = 0;
+            vertices = perVertexArrays[a++];
+            if (!(requiredAttributesMask & NORMAL_OVERALL)) normals = perVertexArrays[a++];
+            if (!(requiredAttributesMask & TANGENT_OVERALL)) tangents = perVertexArrays[a++];
+            if (!(requiredAttributesMask & COLOR_OVERALL)) colors = perVertexArrays[a++];
+            texcoord0 = perVertexArrays[a++];
+            if (!(requiredAttributesMask & TRANSLATE_OVERALL)) translations = perVertexArrays[a++];
+            boneIndices = perVertexArrays[a++];
+            boneWeights = perVertexArrays[a++];
+
+            if (geometryOptions.stats)
             {
-                // see if we have a drawarrays and create a draw command
-                if ((*itr)->getType() == osg::PrimitiveSet::Type::DrawArraysPrimitiveType) //  asDrawArrays != nullptr)
-                {
-                    osg::DrawArrays* da = dynamic_cast<osg::DrawArrays*>((*itr).get());
+                ++geometryOptions.stats->numGeometriesWelded;
+                geometryOptions.stats->numVerticesBeforeWeld += vertexCount;
+                geometryOptions.stats->numVerticesAfterWeld += weldedCount;
+            }
+        }
 
-                    drawCommands.push_back(vsg::Draw::create(da->getCount(), instanceCount, da->getFirst(), 0));
-                }
+        // fill arrays data list THE ORDER HERE IS IMPORTANT
+        vsg::DataList attributeArrays;
+        if (requiredAttributesMask & INTERLEAVED)
+        {
+            std::map<uint32_t, vsg::ref_ptr<vsg::Data>> locationArrays{
+                {VERTEX_CHANNEL, vertices},
+                {NORMAL_CHANNEL, normals},
+                {TANGENT_CHANNEL, tangents},
+                {COLOR_CHANNEL, colors},
+                {TEXCOORD0_CHANNEL, texcoord0},
+                {TRANSLATE_CHANNEL, translations},
+                {BONE_INDICES_CHANNEL, boneIndices},
+                {BONE_WEIGHTS_CHANNEL, boneWeights}
+            };
+            for(uint32_t column = 0; column < instanceMatrixColumns.size(); ++column)
+            {
+                locationArrays[INSTANCE_MATRIX_CHANNEL + column] = instanceMatrixColumns[column];
+            }
+
+            // per vertex attributes go in the interleaved array at binding 0, per instance ones follow in their own arrays
+            VertexAttributes perVertexAttributes;
+            for(auto& attribute : computeVertexAttributes(requiredAttributesMask))
+            {
+                if (attribute.inputRate == VK_VERTEX_INPUT_RATE_VERTEX) perVertexAttributes.push_back(attribute);
+            }
+
+            attributeArrays.push_back(interleaveArrays(perVertexAttributes, locationArrays, vertices->valueCount()));
+
+            for(auto& attribute : computeVertexAttributes(requiredAttributesMask))
+            {
+                if (attribute.inputRate != VK_VERTEX_INPUT_RATE_INSTANCE) continue;
+
+                auto& array = locationArrays[attribute.location];
+                if (array.valid() && array->valueCount() > 0) attributeArrays.push_back(array);
             }
         }
+        else
+        {
+            attributeArrays.push_back(vertices); // always have verticies
+            if (normals.valid() && normals->valueCount() > 0) attributeArrays.push_back(normals);
+            if (tangents.valid() && tangents->valueCount() > 0) attributeArrays.push_back(tangents);
+            if (colors.valid() && colors->valueCount() > 0) attributeArrays.push_back(colors);
+            if (texcoord0.valid() && texcoord0->valueCount() > 0) attributeArrays.push_back(texcoord0);
+            if (translations.valid() && translations->valueCount() > 0) attributeArrays.push_back(translations);
+            for(auto& column : instanceMatrixColumns)
+            {
+                if (column.valid() && column->valueCount() > 0) attributeArrays.push_back(column);
+            }
+            if (boneIndices.valid() && boneIndices->valueCount() > 0) attributeArrays.push_back(boneIndices);
+            if (boneWeights.valid() && boneWeights->valueCount() > 0) attributeArrays.push_back(boneWeights);
+        }
 
-        vsg::ref_ptr<vsg::ushortArray> vsgindices;
+        // pack the indices into 16 bit indices if they fit, otherwise split the mesh into ranges that do or fallback to 32 bit indices
+        vsg::ref_ptr<vsg::Data> vsgindices;
+        IndexRanges indexRanges;
         if(indcies.size() > 0)
         {
-            vsgindices = new vsg::ushortArray(indcies.size());
-            std::copy(indcies.begin(), indcies.end(), reinterpret_cast<uint16_t*>(vsgindices->dataPointer()));
+            uint32_t maxIndex = *std::max_element(indcies.begin(), indcies.end());
+            if (maxIndex <= std::numeric_limits<uint16_t>::max())
+            {
+                indexRanges = runRanges;
+                vsgindices = createIndices<vsg::ushortArray>(indcies, indexRanges);
+            }
+            else if (geometryOptions.splitLargeMeshes && splitIndexRuns(indexRuns, indexRanges))
+            {
+                vsgindices = createIndices<vsg::ushortArray>(indcies, indexRanges);
+            }
+            else
+            {
+                indexRanges = runRanges;
+                vsgindices = createIndices<vsg::uintArray>(indcies, indexRanges);
+            }
+        }
+
+        // a VertexIndexDraw holds a single draw, so meshes with several index ranges, from their primitive sets or from splitLargeMeshes,
+        // need the Geometry's list of draws. The instance count is carried by either form so doesn't affect the choice.
+        bool singleDraw = vsgindices && indexRanges.size() == 1;
+        if (geometryTarget == VSG_AUTO) geometryTarget = singleDraw ? VSG_VERTEXINDEXDRAW : VSG_GEOMETRY;
+
+        if (geometryOptions.stats)
+        {
+            auto& stats = *geometryOptions.stats;
+            if (geometryTarget == VSG_COMMANDS) ++stats.numCommands;
+            else if (geometryTarget == VSG_VERTEXINDEXDRAW && singleDraw) ++stats.numVertexIndexDraws;
+            else
+            {
+                ++stats.numGeometries;
+                if (!vsgindices) ++stats.numGeometriesWithoutIndices;
+                else if (indexRanges.size() > 1) ++stats.numGeometriesWithMultipleDraws;
+                if (geometryTarget == VSG_VERTEXINDEXDRAW) ++stats.numVertexIndexDrawFallbacks;
+            }
         }
 
         if (geometryTarget == VSG_COMMANDS)
@@ -387,29 +1220,27 @@ namespace osg2vsg
 
             commands->addChild( vsg::BindVertexBuffers::create(0, attributeArrays) );
 
-            for(auto& draw : drawCommands)
-            {
-                commands->addChild(draw);
-            }
-
             if(vsgindices)
             {
                 commands->addChild( vsg::BindIndexBuffer::create(vsgindices) );
-                commands->addChild( vsg::DrawIndexed::create(vsgindices->valueCount(), instanceCount, 0, 0, 0) );
+                for(auto& range : indexRanges)
+                {
+                    commands->addChild( vsg::DrawIndexed::create(range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, 0) );
+                }
             }
 
             return commands;
         }
-        else if (geometryTarget == VSG_VERTEXINDEXDRAW && vsgindices && drawCommands.empty())
+        else if (geometryTarget == VSG_VERTEXINDEXDRAW && singleDraw)
         {
             vsg::ref_ptr<vsg::VertexIndexDraw> vid(new vsg::VertexIndexDraw());
 
             vid->arrays = attributeArrays;
             vid->indices = vsgindices;
-            vid->indexCount = vsgindices->size();
+            vid->indexCount = indexRanges.front().indexCount;
             vid->instanceCount = instanceCount;
-            vid->firstIndex = 0;
-            vid->vertexOffset = 0;
+            vid->firstIndex = indexRanges.front().firstIndex;
+            vid->vertexOffset = indexRanges.front().vertexOffset;
             vid->firstInstance = 0;
 
             return vid;
@@ -421,12 +1252,15 @@ namespace osg2vsg
 
         geometry->arrays = attributeArrays;
 
-        // copy into ushortArray
-        if(indcies.size() > 0)
+        vsg::Geometry::DrawCommands drawCommands;
+        if(vsgindices)
         {
             geometry->indices = vsgindices;
 
-            drawCommands.push_back(vsg::DrawIndexed::create(vsgindices->valueCount(), instanceCount, 0, 0, 0));
+            for(auto& range : indexRanges)
+            {
+                drawCommands.push_back(vsg::DrawIndexed::create(range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, 0));
+            }
         }
 
         geometry->commands = drawCommands;
@@ -434,5 +1268,338 @@ namespace osg2vsg
         return geometry;
     }
 
+    namespace
+    {
+        bool isTriangleMesh(const osg::Geometry* geometry)
+        {
+            for(auto& primitiveSet : geometry->getPrimitiveSetList())
+            {
+                if (convertToTopology(static_cast<osg::PrimitiveSet::Mode>(primitiveSet->getMode())) != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST) return false;
+            }
+            return true;
+        }
+
+        // the vertex positions of the geometry, with Vec3dArray vertices relative to origin, empty if they aren't a Vec3Array or Vec3dArray
+        std::vector<vsg::vec3> getPositions(const osg::Geometry* geometry, const vsg::dvec3& origin = vsg::dvec3(0.0, 0.0, 0.0))
+        {
+            std::vector<vsg::vec3> positions;
+            if (auto vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()))
+            {
+                for(auto& v : *vertices) positions.emplace_back(v.x(), v.y(), v.z());
+            }
+            else if (auto dvertices = dynamic_cast<const osg::Vec3dArray*>(geometry->getVertexArray()))
+            {
+                for(auto& v : *dvertices) positions.emplace_back(static_cast<float>(v.x() - origin.x), static_cast<float>(v.y() - origin.y), static_cast<float>(v.z() - origin.z));
+            }
+            return positions;
+        }
+
+        // the vertex positions of a converted geometry, which lead each row of the interleaved arrays, so that they match its indices once
+        // the vertices have been welded. Empty if they aren't a vec3Array or interleaved.
+        std::vector<vsg::vec3> getPositions(const vsg::Geometry* geometry)
+        {
+            std::vector<vsg::vec3> positions;
+            if (geometry->arrays.empty()) return positions;
+
+            if (auto vertices = dynamic_cast<const vsg::vec3Array*>(geometry->arrays.front().get()))
+            {
+                positions.assign(vertices->begin(), vertices->end());
+            }
+            else if (auto interleaved = dynamic_cast<const vsg::ubyteArray2D*>(geometry->arrays.front().get()); interleaved && interleaved->width() >= sizeof(vsg::vec3))
+            {
+                positions.resize(interleaved->height());
+                const uint8_t* src = static_cast<const uint8_t*>(interleaved->dataPointer());
+                for(size_t v = 0; v < positions.size(); ++v) std::memcpy(&positions[v], src + v * interleaved->width(), sizeof(vsg::vec3));
+            }
+            return positions;
+        }
+    }
+
+    bool computeRelativeToCenterOrigin(const osg::Geometry* geometry, const GeometryOptions& geometryOptions, vsg::dvec3& origin)
+    {
+        if (!geometryOptions.relativeToCenter) return false;
+
+        // the shader applies the instance matrices after the transform to the origin, and the bone matrices are in the geometry's own space,
+        // so instanced and skinned geometry are left as is
+        if (geometry->getVertexAttribArray(INSTANCE_MATRIX_CHANNEL) || geometry->getVertexAttribArray(BONE_INDICES_CHANNEL)) return false;
+
+        auto vertices = dynamic_cast<const osg::Vec3dArray*>(geometry->getVertexArray());
+        if (!vertices || vertices->empty()) return false;
+
+        osg::BoundingBoxd bb;
+        for(auto& v : *vertices) bb.expandBy(v);
+
+        origin = vsg::dvec3(bb.center().x(), bb.center().y(), bb.center().z());
+        return true;
+    }
+
+    vsg::ref_ptr<vsg::Node> createRelativeToCenterTransform(const osg::Geometry* geometry, vsg::ref_ptr<vsg::Node> node, const GeometryOptions& geometryOptions)
+    {
+        vsg::dvec3 origin;
+        if (!node || !computeRelativeToCenterOrigin(geometry, geometryOptions, origin)) return node;
+
+        auto transform = vsg::MatrixTransform::create();
+        transform->setMatrix(vsg::translate(origin));
+        transform->addChild(node);
+        return transform;
+    }
+
+    osg::ref_ptr<osg::Geometry> createInstancedGeometry(const osg::Geometry* geometry, const std::vector<osg::Matrix>& matrices)
+    {
+        osg::ref_ptr<osg::Geometry> instanced = new osg::Geometry(*geometry, osg::CopyOp::SHALLOW_COPY);
+
+        for(uint32_t column = 0; column < 4; ++column)
+        {
+            osg::ref_ptr<osg::Vec4Array> columns = new osg::Vec4Array(osg::Array::BIND_OVERALL);
+            for(auto& matrix : matrices)
+            {
+                columns->push_back(osg::Vec4(matrix(column, 0), matrix(column, 1), matrix(column, 2), matrix(column, 3)));
+            }
+            instanced->setVertexAttribArray(INSTANCE_MATRIX_CHANNEL + column, columns);
+        }
+
+        // bound all the instances
+        struct ComputeInstancesBoundingBox : public osg::Drawable::ComputeBoundingBoxCallback
+        {
+            osg::BoundingBox bb;
+
+            ComputeInstancesBoundingBox(const osg::BoundingBox& in_bb) : bb(in_bb) {}
+
+            osg::BoundingBox computeBound(const osg::Drawable&) const override { return bb; }
+        };
+
+        osg::BoundingBox local_bb = geometry->getBoundingBox();
+        osg::BoundingBox bb;
+        for(auto& matrix : matrices)
+        {
+            for(int i=0; i<8; ++i)
+            {
+                bb.expandBy(local_bb.corner(i) * matrix);
+            }
+        }
+        instanced->setComputeBoundingBoxCallback(new ComputeInstancesBoundingBox(bb));
+        instanced->dirtyBound();
+
+        return instanced;
+    }
+
+    vsg::sphere computeBoundingSphere(const osg::Geometry* geometry)
+    {
+        std::vector<vsg::vec3> positions = getPositions(geometry);
+        if (!positions.empty()) return computeBoundingSphere(positions.data(), positions.size());
+
+        const osg::BoundingBox& bb = geometry->getBoundingBox();
+        if (!bb.valid()) return vsg::sphere(vsg::vec3(0.0f, 0.0f, 0.0f), -1.0f);
+
+        return vsg::sphere(vsg::vec3(bb.center().x(), bb.center().y(), bb.center().z()), bb.radius());
+    }
+
+    vsg::ref_ptr<vsg::Node> convertToClusters(osg::Geometry* ingeometry, uint32_t requiredAttributesMask, const GeometryOptions& geometryOptions)
+    {
+        // reject the meshes that can't be clustered before converting them, so that the caller's conversion of them is the only one
+        if (!isTriangleMesh(ingeometry) || computeInstanceCount(ingeometry, requiredAttributesMask) != 1 || computeNumTriangles(ingeometry) == 0) return {};
+
+        auto command = convertToVsg(ingeometry, requiredAttributesMask, VSG_GEOMETRY, geometryOptions);
+        vsg::ref_ptr<vsg::Geometry> geometry(dynamic_cast<vsg::Geometry*>(command.get()));
+        if (!geometry) return {};
+
+        // from here on the converted geometry is returned as is if it can't be clustered, rather than leaving the caller to convert it again
+        if (!geometry->indices) return geometry;
+
+        // read back the converted positions, which the indices address after welding
+        std::vector<vsg::vec3> positions = getPositions(geometry);
+        if (positions.empty()) return geometry;
+
+        auto shortIndices = dynamic_cast<vsg::ushortArray*>(geometry->indices.get());
+        auto intIndices = dynamic_cast<vsg::uintArray*>(geometry->indices.get());
+        if (!shortIndices && !intIndices) return geometry;
+
+        std::vector<uint32_t> indices(geometry->indices->valueCount());
+        for(uint32_t i = 0; i < indices.size(); ++i) indices[i] = shortIndices ? shortIndices->at(i) : intIndices->at(i);
+
+        auto group = vsg::Group::create();
+
+        auto bindArrays = vsg::Commands::create();
+        bindArrays->addChild(vsg::BindVertexBuffers::create(0, geometry->arrays));
+        bindArrays->addChild(vsg::BindIndexBuffer::create(geometry->indices));
+        group->addChild(bindArrays);
+
+        std::vector<vsg::vec4> clusterTable;
+        for(auto& drawCommand : geometry->commands)
+        {
+            auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(drawCommand.get());
+            if (!drawIndexed || drawIndexed->instanceCount != 1) return geometry;
+
+            // cluster the range's indices against the positions they address, then store them relative to the range's vertexOffset again
+            auto rangeBegin = indices.begin() + drawIndexed->firstIndex;
+            std::vector<uint32_t> rangeIndices(rangeBegin, rangeBegin + drawIndexed->indexCount);
+            for(auto& index : rangeIndices) index += drawIndexed->vertexOffset;
+
+            auto clusters = buildClusters(rangeIndices, positions, geometryOptions.maxClusterVertices, geometryOptions.maxClusterTriangles);
+
+            for(auto& index : rangeIndices) index -= drawIndexed->vertexOffset;
+            std::copy(rangeIndices.begin(), rangeIndices.end(), rangeBegin);
+
+            for(auto& cluster : clusters)
+            {
+                auto draw = vsg::DrawIndexed::create(cluster.indexCount, 1, drawIndexed->firstIndex + cluster.firstIndex, drawIndexed->vertexOffset, 0);
+                group->addChild(vsg::CullNode::create(cluster.bound, draw));
+
+                clusterTable.emplace_back(cluster.bound.center.x, cluster.bound.center.y, cluster.bound.center.z, cluster.bound.radius);
+                clusterTable.emplace_back(cluster.coneAxis.x, cluster.coneAxis.y, cluster.coneAxis.z, cluster.coneCutoff);
+            }
+        }
+
+        if (clusterTable.empty()) return geometry;
+
+        for(uint32_t i = 0; i < indices.size(); ++i)
+        {
+            if (shortIndices) shortIndices->at(i) = static_cast<uint16_t>(indices[i]);
+            else intIndices->at(i) = indices[i];
+        }
+
+        auto clusters = vsg::vec4Array::create(static_cast<uint32_t>(clusterTable.size()));
+        std::copy(clusterTable.begin(), clusterTable.end(), &clusters->at(0));
+        group->setObject("Clusters", clusters);
+
+        return group;
+    }
+
+    vsg::ref_ptr<vsg::LOD> createLOD(const vsg::dsphere& bound, const LODChildMap& ratioChildMap)
+    {
+        auto lod = vsg::LOD::create();
+        lod->setBound(bound);
+
+        // add to vsg::LOD in reverse order - highest level of detail first
+        for(auto itr = ratioChildMap.rbegin(); itr != ratioChildMap.rend(); ++itr)
+        {
+            lod->addChild(vsg::LOD::LODChild{itr->first, itr->second});
+        }
+
+        return lod;
+    }
+
+    vsg::ref_ptr<vsg::Node> convertToLOD(osg::Geometry* ingeometry, uint32_t requiredAttributesMask, const GeometryOptions& geometryOptions)
+    {
+        // reject the meshes that won't be simplified before converting them, so that the caller's conversion of them is the only one.
+        // The levels share the vertex arrays so only meshes drawn by a single range from the start of their arrays are simplified,
+        // which rules out meshes that splitLargeMeshes would split into several ranges.
+        if (!isTriangleMesh(ingeometry) || computeInstanceCount(ingeometry, requiredAttributesMask) != 1) return {};
+
+        const osg::Array* inVertices = ingeometry->getVertexArray();
+        if (!inVertices || (geometryOptions.splitLargeMeshes && inVertices->getNumElements() > 65536)) return {};
+        if (computeNumTriangles(ingeometry) < geometryOptions.lodMinTriangles) return {};
+
+        vsg::dvec3 origin;
+        computeRelativeToCenterOrigin(ingeometry, geometryOptions, origin);
+
+        auto command = convertToVsg(ingeometry, requiredAttributesMask, VSG_GEOMETRY, geometryOptions);
+        vsg::ref_ptr<vsg::Geometry> geometry(dynamic_cast<vsg::Geometry*>(command.get()));
+        if (!geometry) return {};
+
+        // from here on the converted geometry is returned as is if it can't be simplified, rather than leaving the caller to convert it again
+        if (!geometry->indices || geometry->commands.size() != 1) return geometry;
+
+        // read back the converted positions, which the indices address after welding
+        std::vector<vsg::vec3> positions = getPositions(geometry);
+        if (positions.empty()) return geometry;
+
+        auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(geometry->commands.front().get());
+        if (!drawIndexed || drawIndexed->instanceCount != 1 || drawIndexed->vertexOffset != 0) return geometry;
+        if (drawIndexed->indexCount / 3 < geometryOptions.lodMinTriangles) return geometry;
+
+        auto shortIndices = dynamic_cast<vsg::ushortArray*>(geometry->indices.get());
+        auto intIndices = dynamic_cast<vsg::uintArray*>(geometry->indices.get());
+        if (!shortIndices && !intIndices) return geometry;
+
+        std::vector<uint32_t> indices(drawIndexed->indexCount);
+        for(uint32_t i = 0; i < indices.size(); ++i)
+        {
+            uint32_t index = drawIndexed->firstIndex + i;
+            indices[i] = shortIndices ? shortIndices->at(index) : intIndices->at(index);
+        }
+
+        // simplify each level from the original mesh, halving the triangles each time. A level with no more error than
+        // the finer levels before it makes them redundant so replaces them.
+        struct Level
+        {
+            std::vector<uint32_t> indices;
+            float error;
+        };
+
+        std::vector<Level> levels{Level{indices, 0.0f}};
+        for(uint32_t l = 1; l <= geometryOptions.numLODLevels; ++l)
+        {
+            size_t targetIndexCount = ((indices.size() >> l) / 3) * 3;
+            if (targetIndexCount == 0) break;
+
+            Level level;
+            level.indices = simplifyMesh(indices, positions, targetIndexCount, &level.error);
+            if (level.indices.empty() || level.indices.size() >= levels.back().indices.size()) break;
+
+            while(!levels.empty() && level.error <= levels.back().error) levels.pop_back();
+            levels.push_back(level);
+        }
+
+        if (levels.size() == 1 && levels.front().indices.size() == indices.size()) return geometry;
+
+        // pack the levels into one index array shared by all the levels
+        size_t numIndices = 0;
+        for(auto& level : levels)
+        {
+            level.indices = optimizeVertexCache(level.indices, static_cast<uint32_t>(positions.size()));
+            numIndices += level.indices.size();
+        }
+
+        vsg::ref_ptr<vsg::Data> levelIndices;
+        if (shortIndices) levelIndices = vsg::ushortArray::create(static_cast<uint32_t>(numIndices));
+        else levelIndices = vsg::uintArray::create(static_cast<uint32_t>(numIndices));
+
+        std::vector<std::pair<uint32_t, uint32_t>> levelRanges;
+        uint32_t firstIndex = 0;
+        for(auto& level : levels)
+        {
+            for(uint32_t i = 0; i < level.indices.size(); ++i)
+            {
+                if (shortIndices) static_cast<vsg::ushortArray*>(levelIndices.get())->at(firstIndex + i) = static_cast<uint16_t>(level.indices[i]);
+                else static_cast<vsg::uintArray*>(levelIndices.get())->at(firstIndex + i) = level.indices[i];
+            }
+            levelRanges.emplace_back(firstIndex, static_cast<uint32_t>(level.indices.size()));
+            firstIndex += static_cast<uint32_t>(level.indices.size());
+        }
+
+        auto createLevel = [&](size_t l) {
+            auto levelGeometry = vsg::Geometry::create();
+            levelGeometry->arrays = geometry->arrays;
+            levelGeometry->indices = levelIndices;
+            levelGeometry->commands.push_back(vsg::DrawIndexed::create(levelRanges[l].second, 1, levelRanges[l].first, 0, 0));
+            return levelGeometry;
+        };
+
+        if (levels.size() == 1) return createLevel(0);
+
+        const osg::BoundingBox& bb = ingeometry->getBoundingBox();
+        double radius = bb.radius();
+
+        // a level is drawn until the error of the next coarser level would cover more than lodPixelError pixels, using
+        // the same reference 1080 pixel high screen as the screen height ratios converted from osg::LOD ranges
+        const double pixel_ratio = 1.0/1080.0;
+
+        LODChildMap ratioChildMap;
+        for(size_t l = 0; l < levels.size(); ++l)
+        {
+            double minimumScreenHeightRatio = 0.0;
+            if (l + 1 < levels.size())
+            {
+                double error = std::max(static_cast<double>(levels[l + 1].error), radius * 1e-6);
+                minimumScreenHeightRatio = geometryOptions.lodPixelError * pixel_ratio * radius / error;
+            }
+            ratioChildMap[minimumScreenHeightRatio] = createLevel(l);
+        }
+
+        vsg::dvec3 center = vsg::dvec3(bb.center().x(), bb.center().y(), bb.center().z()) - origin;
+        return createLOD(vsg::dsphere(center.x, center.y, center.z, radius), ratioChildMap);
+    }
+
 }
 
@@ -0,0 +1,387 @@
+#include <osg2vsg/MeshCodec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace osg2vsg;
+
+namespace
+{
+    const char encodedMagic[8] = {'o', 's', 'g', '2', 'v', 's', 'g', 'M'};
+    const uint8_t encodedVersion = 1;
+
+    enum EncodedType : uint8_t
+    {
+        FLOAT_ARRAY,
+        VEC2_ARRAY,
+        VEC3_ARRAY,
+        VEC4_ARRAY,
+        SVEC2_ARRAY,
+        SVEC4_ARRAY,
+        UBVEC4_ARRAY,
+        USVEC2_ARRAY,
+        USHORT_ARRAY,
+        UINT_ARRAY,
+        UBYTE_ARRAY,
+        UBYTE_ARRAY2D
+    };
+
+    // fixed size header at the start of every encoded array, followed by the min and scale of each component when quantized
+    struct EncodedHeader
+    {
+        char magic[8];
+        uint8_t version;
+        uint8_t type;
+        uint8_t quantizationBits;
+        uint8_t reserved;
+        uint32_t valueCount; // values, or rows of a UBYTE_ARRAY2D
+        uint32_t numComponents; // components of each value, or bytes in each row of a UBYTE_ARRAY2D
+        uint32_t componentSize;
+    };
+
+    struct TypeInfo
+    {
+        EncodedType type;
+        uint32_t valueCount;
+        uint32_t numComponents;
+        uint32_t componentSize;
+        bool isFloat;
+    };
+
+    bool getTypeInfo(const vsg::Data* array, TypeInfo& info)
+    {
+        auto set = [&](EncodedType type, uint32_t numComponents, uint32_t componentSize, bool isFloat)
+        {
+            info = TypeInfo{type, static_cast<uint32_t>(array->valueCount()), numComponents, componentSize, isFloat};
+            return true;
+        };
+
+        if (dynamic_cast<const vsg::floatArray*>(array)) return set(FLOAT_ARRAY, 1, 4, true);
+        if (dynamic_cast<const vsg::vec2Array*>(array)) return set(VEC2_ARRAY, 2, 4, true);
+        if (dynamic_cast<const vsg::vec3Array*>(array)) return set(VEC3_ARRAY, 3, 4, true);
+        if (dynamic_cast<const vsg::vec4Array*>(array)) return set(VEC4_ARRAY, 4, 4, true);
+        if (dynamic_cast<const vsg::svec2Array*>(array)) return set(SVEC2_ARRAY, 2, 2, false);
+        if (dynamic_cast<const vsg::svec4Array*>(array)) return set(SVEC4_ARRAY, 4, 2, false);
+        if (dynamic_cast<const vsg::ubvec4Array*>(array)) return set(UBVEC4_ARRAY, 4, 1, false);
+        if (dynamic_cast<const vsg::usvec2Array*>(array)) return set(USVEC2_ARRAY, 2, 2, false);
+        if (dynamic_cast<const vsg::ushortArray*>(array)) return set(USHORT_ARRAY, 1, 2, false);
+        if (dynamic_cast<const vsg::uintArray*>(array)) return set(UINT_ARRAY, 1, 4, false);
+        if (dynamic_cast<const vsg::ubyteArray*>(array)) return set(UBYTE_ARRAY, 1, 1, false);
+        if (auto array2D = dynamic_cast<const vsg::ubyteArray2D*>(array))
+        {
+            info = TypeInfo{UBYTE_ARRAY2D, array2D->height(), array2D->width(), 1, false};
+            return true;
+        }
+        return false;
+    }
+
+    vsg::ref_ptr<vsg::Data> createArray(uint8_t type, uint32_t valueCount, uint32_t numComponents)
+    {
+        switch(type)
+        {
+            case(FLOAT_ARRAY): return vsg::floatArray::create(valueCount);
+            case(VEC2_ARRAY): return vsg::vec2Array::create(valueCount);
+            case(VEC3_ARRAY): return vsg::vec3Array::create(valueCount);
+            case(VEC4_ARRAY): return vsg::vec4Array::create(valueCount);
+            case(SVEC2_ARRAY): return vsg::svec2Array::create(valueCount);
+            case(SVEC4_ARRAY): return vsg::svec4Array::create(valueCount);
+            case(UBVEC4_ARRAY): return vsg::ubvec4Array::create(valueCount);
+            case(USVEC2_ARRAY): return vsg::usvec2Array::create(valueCount);
+            case(USHORT_ARRAY): return vsg::ushortArray::create(valueCount);
+            case(UINT_ARRAY): return vsg::uintArray::create(valueCount);
+            case(UBYTE_ARRAY): return vsg::ubyteArray::create(valueCount);
+            case(UBYTE_ARRAY2D): return vsg::ubyteArray2D::create(numComponents, valueCount);
+            default: return {};
+        }
+    }
+
+    uint32_t readComponent(const uint8_t* src, uint32_t componentSize)
+    {
+        switch(componentSize)
+        {
+            case(1): return *src;
+            case(2): { uint16_t value; std::memcpy(&value, src, 2); return value; }
+            default: { uint32_t value; std::memcpy(&value, src, 4); return value; }
+        }
+    }
+
+    void writeComponent(uint8_t* dest, uint32_t componentSize, uint32_t value)
+    {
+        switch(componentSize)
+        {
+            case(1): *dest = static_cast<uint8_t>(value); break;
+            case(2): { uint16_t value16 = static_cast<uint16_t>(value); std::memcpy(dest, &value16, 2); break; }
+            default: std::memcpy(dest, &value, 4); break;
+        }
+    }
+
+    // the difference between successive components, wrapped to the component's width and mapped so that small negative and
+    // positive differences both become small unsigned values
+    uint64_t zigzagDelta(uint32_t value, uint32_t previous, uint32_t numBits)
+    {
+        uint64_t mask = (uint64_t(1) << numBits) - 1;
+        uint64_t delta = (uint64_t(value) - uint64_t(previous)) & mask;
+        int64_t signedDelta = (delta >> (numBits - 1)) ? int64_t(delta) - int64_t(mask) - 1 : int64_t(delta);
+        return (uint64_t(signedDelta) << 1) ^ uint64_t(signedDelta >> 63);
+    }
+
+    uint32_t applyZigzagDelta(uint64_t zigzag, uint32_t previous, uint32_t numBits)
+    {
+        int64_t signedDelta = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+        uint64_t mask = (uint64_t(1) << numBits) - 1;
+        return static_cast<uint32_t>((uint64_t(previous) + uint64_t(signedDelta)) & mask);
+    }
+
+    void writeVarint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool readVarint(const uint8_t*& ptr, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for(uint32_t shift = 0; ptr < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *ptr++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+}
+
+vsg::ref_ptr<vsg::ubyteArray> osg2vsg::encodeArray(const vsg::Data* array, uint32_t quantizationBits)
+{
+    TypeInfo info;
+    if (!array || !getTypeInfo(array, info) || info.valueCount == 0) return {};
+
+    bool quantize = info.isFloat && quantizationBits >= 1 && quantizationBits <= 24;
+    uint32_t numBits = quantize ? quantizationBits : info.componentSize * 8;
+    uint32_t stride = info.numComponents * info.componentSize;
+    const uint8_t* src = static_cast<const uint8_t*>(array->dataPointer());
+
+    EncodedHeader header{};
+    std::memcpy(header.magic, encodedMagic, sizeof(encodedMagic));
+    header.version = encodedVersion;
+    header.type = info.type;
+    header.quantizationBits = quantize ? static_cast<uint8_t>(quantizationBits) : 0;
+    header.valueCount = info.valueCount;
+    header.numComponents = info.numComponents;
+    header.componentSize = info.componentSize;
+
+    std::vector<uint8_t> out(sizeof(EncodedHeader));
+    std::memcpy(out.data(), &header, sizeof(EncodedHeader));
+
+    // quantize each float component across its range, storing the min and scale needed to restore it
+    std::vector<float> componentMin(info.numComponents, 0.0f);
+    std::vector<float> componentScale(info.numComponents, 0.0f);
+    if (quantize)
+    {
+        std::vector<float> componentMax(info.numComponents, 0.0f);
+        for(uint32_t c = 0; c < info.numComponents; ++c)
+        {
+            componentMin[c] = std::numeric_limits<float>::max();
+            componentMax[c] = std::numeric_limits<float>::lowest();
+        }
+
+        for(uint32_t v = 0; v < info.valueCount; ++v)
+        {
+            const float* values = reinterpret_cast<const float*>(src + size_t(v) * stride);
+            for(uint32_t c = 0; c < info.numComponents; ++c)
+            {
+                componentMin[c] = std::min(componentMin[c], values[c]);
+                componentMax[c] = std::max(componentMax[c], values[c]);
+            }
+        }
+
+        float maxQuantized = float((uint32_t(1) << quantizationBits) - 1);
+        for(uint32_t c = 0; c < info.numComponents; ++c)
+        {
+            componentScale[c] = (componentMax[c] - componentMin[c]) / maxQuantized;
+
+            const uint8_t* minBytes = reinterpret_cast<const uint8_t*>(&componentMin[c]);
+            const uint8_t* scaleBytes = reinterpret_cast<const uint8_t*>(&componentScale[c]);
+            out.insert(out.end(), minBytes, minBytes + sizeof(float));
+            out.insert(out.end(), scaleBytes, scaleBytes + sizeof(float));
+        }
+    }
+
+    std::vector<uint32_t> previous(info.numComponents, 0);
+    for(uint32_t v = 0; v < info.valueCount; ++v)
+    {
+        const uint8_t* value = src + size_t(v) * stride;
+        for(uint32_t c = 0; c < info.numComponents; ++c)
+        {
+            uint32_t component = 0;
+            if (quantize)
+            {
+                float f = reinterpret_cast<const float*>(value)[c];
+                component = componentScale[c] > 0.0f ? static_cast<uint32_t>(std::lround((f - componentMin[c]) / componentScale[c])) : 0;
+            }
+            else
+            {
+                component = readComponent(value + c * info.componentSize, info.componentSize);
+            }
+
+            writeVarint(out, zigzagDelta(component, previous[c], numBits));
+            previous[c] = component;
+        }
+    }
+
+    auto encoded = vsg::ubyteArray::create(static_cast<uint32_t>(out.size()));
+    std::memcpy(encoded->dataPointer(), out.data(), out.size());
+    return encoded;
+}
+
+bool osg2vsg::isEncodedArray(const vsg::Data* data)
+{
+    auto array = dynamic_cast<const vsg::ubyteArray*>(data);
+    if (!array || array->dataSize() < sizeof(EncodedHeader)) return false;
+
+    return std::memcmp(array->dataPointer(), encodedMagic, sizeof(encodedMagic)) == 0;
+}
+
+vsg::ref_ptr<vsg::Data> osg2vsg::decodeArray(const vsg::Data* data)
+{
+    if (!isEncodedArray(data)) return {};
+
+    const uint8_t* ptr = static_cast<const uint8_t*>(data->dataPointer());
+    const uint8_t* end = ptr + data->dataSize();
+
+    EncodedHeader header;
+    std::memcpy(&header, ptr, sizeof(EncodedHeader));
+    ptr += sizeof(EncodedHeader);
+
+    if (header.version != encodedVersion) return {};
+
+    auto array = createArray(header.type, header.valueCount, header.numComponents);
+    TypeInfo info;
+    if (!array || !getTypeInfo(array, info) || info.numComponents != header.numComponents || info.componentSize != header.componentSize) return {};
+
+    bool quantize = header.quantizationBits > 0;
+    if (quantize && !info.isFloat) return {};
+
+    uint32_t numBits = quantize ? header.quantizationBits : info.componentSize * 8;
+    uint32_t stride = info.numComponents * info.componentSize;
+
+    std::vector<float> componentMin(info.numComponents, 0.0f);
+    std::vector<float> componentScale(info.numComponents, 0.0f);
+    if (quantize)
+    {
+        if (size_t(end - ptr) < info.numComponents * 2 * sizeof(float)) return {};
+        for(uint32_t c = 0; c < info.numComponents; ++c)
+        {
+            std::memcpy(&componentMin[c], ptr, sizeof(float));
+            std::memcpy(&componentScale[c], ptr + sizeof(float), sizeof(float));
+            ptr += 2 * sizeof(float);
+        }
+    }
+
+    uint8_t* dest = static_cast<uint8_t*>(array->dataPointer());
+    std::vector<uint32_t> previous(info.numComponents, 0);
+    for(uint32_t v = 0; v < info.valueCount; ++v)
+    {
+        uint8_t* value = dest + size_t(v) * stride;
+        for(uint32_t c = 0; c < info.numComponents; ++c)
+        {
+            uint64_t zigzag;
+            if (!readVarint(ptr, end, zigzag)) return {};
+
+            uint32_t component = applyZigzagDelta(zigzag, previous[c], numBits);
+            previous[c] = component;
+
+            if (quantize) reinterpret_cast<float*>(value)[c] = componentMin[c] + float(component) * componentScale[c];
+            else writeComponent(value + c * info.componentSize, info.componentSize, component);
+        }
+    }
+
+    return array;
+}
+
+void EncodeMeshes::apply(vsg::Object& object)
+{
+    object.traverse(*this);
+}
+
+void EncodeMeshes::apply(vsg::Geometry& geometry)
+{
+    for(auto& array : geometry.arrays) array = encode(array);
+    geometry.indices = encode(geometry.indices);
+}
+
+void EncodeMeshes::apply(vsg::VertexIndexDraw& vid)
+{
+    for(auto& array : vid.arrays) array = encode(array);
+    vid.indices = encode(vid.indices);
+}
+
+void EncodeMeshes::apply(vsg::BindVertexBuffers& bvb)
+{
+    for(auto& array : bvb.getArrays()) array = encode(array);
+}
+
+vsg::ref_ptr<vsg::Data> EncodeMeshes::encode(vsg::ref_ptr<vsg::Data> data)
+{
+    if (!data || isEncodedArray(data)) return data;
+
+    if (auto itr = _encoded.find(data.get()); itr != _encoded.end()) return itr->second;
+
+    vsg::ref_ptr<vsg::Data> result = data;
+    if (auto encoded = encodeArray(data, quantizationBits); encoded && encoded->dataSize() < data->dataSize())
+    {
+        result = encoded;
+    }
+
+    numBytesBefore += data->dataSize();
+    numBytesAfter += result->dataSize();
+
+    _encoded[data.get()] = result;
+    return result;
+}
+
+void EncodeMeshes::print(std::ostream& out) const
+{
+    out<<"EncodeMeshes : "<<numBytesBefore<<" bytes of arrays encoded to "<<numBytesAfter<<" bytes"<<std::endl;
+}
+
+void DecodeMeshes::apply(vsg::Object& object)
+{
+    object.traverse(*this);
+}
+
+void DecodeMeshes::apply(vsg::Geometry& geometry)
+{
+    for(auto& array : geometry.arrays) array = decode(array);
+    geometry.indices = decode(geometry.indices);
+}
+
+void DecodeMeshes::apply(vsg::VertexIndexDraw& vid)
+{
+    for(auto& array : vid.arrays) array = decode(array);
+    vid.indices = decode(vid.indices);
+}
+
+void DecodeMeshes::apply(vsg::BindVertexBuffers& bvb)
+{
+    for(auto& array : bvb.getArrays()) array = decode(array);
+}
+
+vsg::ref_ptr<vsg::Data> DecodeMeshes::decode(vsg::ref_ptr<vsg::Data> data)
+{
+    if (!isEncodedArray(data)) return data;
+
+    if (auto itr = _decoded.find(data.get()); itr != _decoded.end()) return itr->second;
+
+    auto decoded = decodeArray(data);
+    if (!decoded) return data;
+
+    _decoded[data.get()] = decoded;
+    return decoded;
+}
@@ -0,0 +1,1252 @@
+#include <osg2vsg/MeshOptimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+
+using namespace osg2vsg;
+
+namespace
+{
+    const uint32_t forsythCacheSize = 32;
+    const uint32_t invalidIndex = std::numeric_limits<uint32_t>::max();
+
+    // Forsyth's vertex score, favouring vertices recently used and vertices with few triangles left to draw
+    float vertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0) return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the vertices of the last triangle get a fixed score so that the next triangle doesn't depend on their order
+            if (cachePosition < 3) score = 0.75f;
+            else score = std::pow(1.0f - float(cachePosition - 3) / float(forsythCacheSize - 3), 1.5f);
+        }
+
+        score += 2.0f / std::sqrt(float(remainingTriangles));
+        return score;
+    }
+
+    // number of vertices in the array, the interleaved arrays hold one row per vertex
+    uint32_t numVertices(const vsg::Data* array)
+    {
+        if (auto interleaved = dynamic_cast<const vsg::ubyteArray2D*>(array)) return interleaved->height();
+        return static_cast<uint32_t>(array->valueCount());
+    }
+
+    // the vertex positions, which lead each row of the interleaved arrays, empty if they can't be read
+    std::vector<vsg::vec3> readPositions(const vsg::Data* array, uint32_t vertexCount)
+    {
+        std::vector<vsg::vec3> positions(vertexCount);
+        if (auto vertices = dynamic_cast<const vsg::vec3Array*>(array))
+        {
+            std::memcpy(positions.data(), vertices->dataPointer(), vertexCount * sizeof(vsg::vec3));
+        }
+        else if (auto interleaved = dynamic_cast<const vsg::ubyteArray2D*>(array); interleaved && interleaved->width() >= sizeof(vsg::vec3))
+        {
+            const uint8_t* src = static_cast<const uint8_t*>(interleaved->dataPointer());
+            for(uint32_t v = 0; v < vertexCount; ++v) std::memcpy(&positions[v], src + v * interleaved->width(), sizeof(vsg::vec3));
+        }
+        else
+        {
+            positions.clear();
+        }
+        return positions;
+    }
+
+    template<class A>
+    std::vector<uint32_t> readIndices(const vsg::Data* data)
+    {
+        using value_type = typename A::value_type;
+        auto array = static_cast<const A*>(data);
+        const value_type* src = static_cast<const value_type*>(array->dataPointer());
+        return std::vector<uint32_t>(src, src + array->valueCount());
+    }
+
+    template<class A>
+    void writeIndices(vsg::Data* data, const std::vector<uint32_t>& indices)
+    {
+        using value_type = typename A::value_type;
+        value_type* dest = static_cast<value_type*>(data->dataPointer());
+        for(size_t i = 0; i < indices.size(); ++i) dest[i] = static_cast<value_type>(indices[i]);
+    }
+
+    void optimizeMesh(OptimizeMeshes::Mesh& mesh)
+    {
+        bool shortIndices = dynamic_cast<vsg::ushortArray*>(mesh.indices.get()) != nullptr;
+        std::vector<uint32_t> indices = shortIndices ? readIndices<vsg::ushortArray>(mesh.indices) : readIndices<vsg::uintArray>(mesh.indices);
+
+        uint32_t vertexCount = numVertices(mesh.arrays.front());
+
+        std::vector<vsg::vec3> positions;
+        if (mesh.overdrawThreshold > 0.0f) positions = readPositions(mesh.arrays.front(), vertexCount);
+
+        // each range's triangles are reordered within the range, working on the vertex numbers the range's indices address
+        std::vector<uint32_t> drawnIndices;
+        for(auto& range : mesh.ranges)
+        {
+            // ranges drawn with other topologies are left as they are, as are triangle lists cut short
+            if (range.topology != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST || range.indexCount < 3 || (range.indexCount % 3) != 0) continue;
+
+            auto begin = indices.begin() + range.firstIndex;
+            std::vector<uint32_t> rangeIndices(begin, begin + range.indexCount);
+            for(auto& index : rangeIndices) index += range.vertexOffset;
+
+            mesh.numTriangles += rangeIndices.size() / 3;
+            mesh.numCacheMissesBefore += computeCacheMisses(rangeIndices);
+
+            rangeIndices = optimizeVertexCache(rangeIndices, vertexCount);
+            if (!positions.empty()) rangeIndices = optimizeOverdraw(rangeIndices, positions, mesh.overdrawThreshold);
+
+            mesh.numCacheMissesAfter += computeCacheMisses(rangeIndices);
+
+            drawnIndices.insert(drawnIndices.end(), rangeIndices.begin(), rangeIndices.end());
+            for(auto& index : rangeIndices) index -= range.vertexOffset;
+            std::copy(rangeIndices.begin(), rangeIndices.end(), begin);
+        }
+
+        // vertices are only reordered when all the ranges address them from vertex 0, see OptimizeMeshes::optimize()
+        if (mesh.reorderVertices && !drawnIndices.empty())
+        {
+            auto remap = computeVertexFetchRemap(drawnIndices, vertexCount);
+            for(auto& range : mesh.ranges)
+            {
+                for(uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; ++i) indices[i] = remap[indices[i]];
+            }
+
+            // move each vertex's bytes to its new position, working on the raw data so that interleaved and quantized arrays are handled too
+            std::vector<uint8_t> original;
+            for(auto& array : mesh.arrays)
+            {
+                if (numVertices(array) != vertexCount) continue;
+
+                size_t stride = array->dataSize() / vertexCount;
+                uint8_t* data = static_cast<uint8_t*>(array->dataPointer());
+                original.assign(data, data + array->dataSize());
+                for(uint32_t v = 0; v < vertexCount; ++v)
+                {
+                    std::memcpy(data + remap[v] * stride, original.data() + v * stride, stride);
+                }
+            }
+        }
+
+        if (shortIndices) writeIndices<vsg::ushortArray>(mesh.indices, indices);
+        else writeIndices<vsg::uintArray>(mesh.indices, indices);
+    }
+
+    struct OptimizeMeshOperation : public vsg::Operation
+    {
+        OptimizeMeshOperation(OptimizeMeshes::Mesh& in_mesh, vsg::ref_ptr<vsg::Latch> in_latch) :
+            mesh(in_mesh),
+            latch(in_latch) {}
+
+        void run() override
+        {
+            optimizeMesh(mesh);
+            latch->count_down();
+        }
+
+        OptimizeMeshes::Mesh& mesh;
+        vsg::ref_ptr<vsg::Latch> latch;
+    };
+}
+
+std::vector<uint32_t> osg2vsg::optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) return indices;
+
+    // triangles adjacent to each vertex, the triangles still to be drawn are kept at the start of each vertex's list
+    std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+    for(size_t i = 0; i < numTriangles * 3; ++i) ++remainingTriangles[indices[i]];
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for(uint32_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTriangles[v];
+
+    std::vector<uint32_t> adjacency(numTriangles * 3);
+    {
+        std::vector<uint32_t> fillPositions(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(size_t t = 0; t < numTriangles; ++t)
+        {
+            for(size_t k = 0; k < 3; ++k) adjacency[fillPositions[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for(uint32_t v = 0; v < vertexCount; ++v) vertexScores[v] = vertexScore(-1, remainingTriangles[v]);
+
+    std::vector<float> triangleScores(numTriangles);
+    std::vector<bool> emitted(numTriangles, false);
+    size_t bestTriangle = 0;
+    for(size_t t = 0; t < numTriangles; ++t)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        if (triangleScores[t] > triangleScores[bestTriangle]) bestTriangle = t;
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(numTriangles * 3);
+
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve(forsythCacheSize + 3);
+    newCache.reserve(forsythCacheSize + 3);
+
+    size_t scanPosition = 0;
+    for(size_t n = 0; n < numTriangles; ++n)
+    {
+        // when no triangle in the cache is left to draw, fall back to the next triangle not yet drawn
+        if (bestTriangle == invalidIndex)
+        {
+            while (emitted[scanPosition]) ++scanPosition;
+            bestTriangle = scanPosition;
+        }
+
+        emitted[bestTriangle] = true;
+        const uint32_t* triangle = &indices[bestTriangle * 3];
+
+        newCache.clear();
+        for(size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = triangle[k];
+            result.push_back(v);
+
+            // move the triangle out of the vertex's list of remaining triangles
+            auto begin = adjacency.begin() + adjacencyOffsets[v];
+            auto end = begin + remainingTriangles[v];
+            std::iter_swap(std::find(begin, end, static_cast<uint32_t>(bestTriangle)), end - 1);
+            --remainingTriangles[v];
+
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) newCache.push_back(v);
+        }
+
+        // LRU cache update, the triangle's vertices go to the front
+        for(auto v : cache)
+        {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) newCache.push_back(v);
+        }
+
+        for(size_t i = 0; i < newCache.size(); ++i)
+        {
+            uint32_t v = newCache[i];
+            cachePositions[v] = i < forsythCacheSize ? static_cast<int32_t>(i) : -1;
+            vertexScores[v] = vertexScore(cachePositions[v], remainingTriangles[v]);
+        }
+
+        // rescore the triangles touching the cache and pick the best of them to draw next
+        bestTriangle = invalidIndex;
+        float bestScore = -1.0f;
+        for(auto v : newCache)
+        {
+            auto begin = adjacency.begin() + adjacencyOffsets[v];
+            auto end = begin + remainingTriangles[v];
+            for(auto itr = begin; itr != end; ++itr)
+            {
+                uint32_t t = *itr;
+                triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > forsythCacheSize) newCache.resize(forsythCacheSize);
+        cache.swap(newCache);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> osg2vsg::computeVertexFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, invalidIndex);
+
+    uint32_t next = 0;
+    for(auto index : indices)
+    {
+        if (remap[index] == invalidIndex) remap[index] = next++;
+    }
+
+    for(auto& newIndex : remap)
+    {
+        if (newIndex == invalidIndex) newIndex = next++;
+    }
+
+    return remap;
+}
+
+uint64_t osg2vsg::computeCacheMisses(const std::vector<uint32_t>& indices, uint32_t cacheSize)
+{
+    if (indices.empty()) return 0;
+
+    // a vertex is still in the FIFO if fewer than cacheSize vertices have been added since it was
+    uint32_t maxIndex = *std::max_element(indices.begin(), indices.end());
+    std::vector<uint64_t> timeAdded(static_cast<size_t>(maxIndex) + 1, 0);
+
+    uint64_t numMisses = 0;
+    for(auto index : indices)
+    {
+        if (timeAdded[index] == 0 || (numMisses + 1 - timeAdded[index]) > cacheSize)
+        {
+            ++numMisses;
+            timeAdded[index] = numMisses;
+        }
+    }
+    return numMisses;
+}
+
+std::vector<uint32_t> osg2vsg::optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, float threshold, uint32_t cacheSize)
+{
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles < 2 || positions.empty()) return indices;
+
+    // FIFO cache simulation as in computeCacheMisses(), which can be flushed at the start of each cluster
+    std::vector<uint64_t> timeAdded(positions.size(), 0);
+    uint64_t time = 0;
+    uint64_t flushTime = 0;
+    auto triangleMisses = [&](size_t t)
+    {
+        uint32_t numMisses = 0;
+        for(size_t i = t * 3; i < t * 3 + 3; ++i)
+        {
+            uint32_t index = indices[i];
+            if (timeAdded[index] <= flushTime || (time + 1 - timeAdded[index]) > cacheSize)
+            {
+                timeAdded[index] = ++time;
+                ++numMisses;
+            }
+        }
+        return numMisses;
+    };
+    auto flushCache = [&]() { flushTime = time; };
+
+    // hard boundaries where the cache optimized order starts afresh, each triangle missing on all its vertices
+    std::vector<size_t> hardBoundaries{0};
+    for(size_t t = 0; t < numTriangles; ++t)
+    {
+        if (triangleMisses(t) == 3 && t > 0) hardBoundaries.push_back(t);
+    }
+    hardBoundaries.push_back(numTriangles);
+
+    // soft boundaries splitting each hard cluster wherever the cache miss ratio since the last boundary has fallen within threshold of
+    // the whole cluster's, so that smaller clusters can be sorted without losing much vertex cache efficiency
+    std::vector<size_t> boundaries;
+    for(size_t c = 0; c + 1 < hardBoundaries.size(); ++c)
+    {
+        size_t start = hardBoundaries[c];
+        size_t end = hardBoundaries[c + 1];
+
+        flushCache();
+        uint64_t clusterMisses = 0;
+        for(size_t t = start; t < end; ++t) clusterMisses += triangleMisses(t);
+        double maxRatio = threshold * double(clusterMisses) / double(end - start);
+
+        flushCache();
+        boundaries.push_back(start);
+        size_t subStart = start;
+        uint64_t subMisses = 0;
+        for(size_t t = start; t < end; ++t)
+        {
+            subMisses += triangleMisses(t);
+            if (t + 1 < end && double(subMisses) / double(t + 1 - subStart) <= maxRatio)
+            {
+                boundaries.push_back(t + 1);
+                subStart = t + 1;
+                subMisses = 0;
+                flushCache();
+            }
+        }
+    }
+    boundaries.push_back(numTriangles);
+
+    // the clusters facing out from the center of the mesh are the ones most likely to be in front from typical viewpoints
+    vsg::vec3 meshCenter(0.0f, 0.0f, 0.0f);
+    for(size_t i = 0; i < numTriangles * 3; ++i) meshCenter += positions[indices[i]];
+    meshCenter = meshCenter / float(numTriangles * 3);
+
+    size_t numClusters = boundaries.size() - 1;
+    std::vector<float> sortKeys(numClusters);
+    for(size_t c = 0; c < numClusters; ++c)
+    {
+        vsg::vec3 center(0.0f, 0.0f, 0.0f);
+        vsg::vec3 normal(0.0f, 0.0f, 0.0f);
+        for(size_t t = boundaries[c]; t < boundaries[c + 1]; ++t)
+        {
+            const vsg::vec3& p0 = positions[indices[t * 3]];
+            const vsg::vec3& p1 = positions[indices[t * 3 + 1]];
+            const vsg::vec3& p2 = positions[indices[t * 3 + 2]];
+            center += p0 + p1 + p2;
+            normal += vsg::cross(p1 - p0, p2 - p0);
+        }
+        center = center / float((boundaries[c + 1] - boundaries[c]) * 3);
+
+        float normalLength = vsg::length(normal);
+        sortKeys[c] = normalLength > 0.0f ? vsg::dot(center - meshCenter, normal / normalLength) : 0.0f;
+    }
+
+    std::vector<size_t> clusterOrder(numClusters);
+    for(size_t c = 0; c < numClusters; ++c) clusterOrder[c] = c;
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t lhs, size_t rhs) { return sortKeys[lhs] > sortKeys[rhs]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(auto c : clusterOrder)
+    {
+        result.insert(result.end(), indices.begin() + boundaries[c] * 3, indices.begin() + boundaries[c + 1] * 3);
+    }
+
+    // keep any trailing indices that don't form a whole triangle
+    result.insert(result.end(), indices.begin() + numTriangles * 3, indices.end());
+
+    return result;
+}
+
+namespace
+{
+    // symmetric 4x4 matrix measuring the weighted squared distance of a point from a set of planes
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+        double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+        double a22 = 0.0, a23 = 0.0;
+        double a33 = 0.0;
+        double weight = 0.0;
+
+        void addPlane(double a, double b, double c, double d, double w)
+        {
+            a00 += w * a * a; a01 += w * a * b; a02 += w * a * c; a03 += w * a * d;
+            a11 += w * b * b; a12 += w * b * c; a13 += w * b * d;
+            a22 += w * c * c; a23 += w * c * d;
+            a33 += w * d * d;
+            weight += w;
+        }
+
+        Quadric& operator += (const Quadric& rhs)
+        {
+            a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02; a03 += rhs.a03;
+            a11 += rhs.a11; a12 += rhs.a12; a13 += rhs.a13;
+            a22 += rhs.a22; a23 += rhs.a23;
+            a33 += rhs.a33;
+            weight += rhs.weight;
+            return *this;
+        }
+
+        // the weighted mean squared distance of p from the planes
+        double error(const vsg::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z) + a33;
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double error;
+
+        bool operator < (const Collapse& rhs) const { return error < rhs.error; }
+    };
+
+    Cluster computeClusterBounds(const uint32_t* indices, uint32_t indexCount, const std::vector<vsg::vec3>& positions)
+    {
+        Cluster cluster{0, indexCount, {}, {0.0f, 0.0f, 0.0f}, 1.0f};
+
+        std::vector<vsg::vec3> points(indexCount);
+        for(uint32_t i = 0; i < indexCount; ++i) points[i] = positions[indices[i]];
+        cluster.bound = computeBoundingSphere(points.data(), points.size());
+
+        // the cone axis is the mean of the triangle normals, the cone just wide enough to contain all of them
+        std::vector<vsg::vec3> normals;
+        normals.reserve(indexCount / 3);
+        vsg::vec3 axis(0.0f, 0.0f, 0.0f);
+        for(uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            auto& p0 = positions[indices[i]];
+            vsg::vec3 normal = vsg::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+            float area = vsg::length(normal);
+            if (area == 0.0f) continue;
+
+            normals.push_back(normal / area);
+            axis += normals.back();
+        }
+
+        float axisLength = vsg::length(axis);
+        if (normals.empty() || axisLength == 0.0f) return cluster;
+
+        axis = axis / axisLength;
+
+        float minDot = 1.0f;
+        for(auto& normal : normals) minDot = std::min(minDot, vsg::dot(normal, axis));
+
+        cluster.coneAxis = axis;
+        if (minDot > 0.0f) cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+        return cluster;
+    }
+}
+
+vsg::sphere osg2vsg::computeBoundingSphere(const vsg::vec3* points, size_t numPoints)
+{
+    if (numPoints == 0) return vsg::sphere(vsg::vec3(0.0f, 0.0f, 0.0f), -1.0f);
+
+    size_t minIndex[3] = {0, 0, 0};
+    size_t maxIndex[3] = {0, 0, 0};
+    for(size_t i = 1; i < numPoints; ++i)
+    {
+        const vsg::vec3& p = points[i];
+        if (p.x < points[minIndex[0]].x) minIndex[0] = i;
+        if (p.y < points[minIndex[1]].y) minIndex[1] = i;
+        if (p.z < points[minIndex[2]].z) minIndex[2] = i;
+        if (p.x > points[maxIndex[0]].x) maxIndex[0] = i;
+        if (p.y > points[maxIndex[1]].y) maxIndex[1] = i;
+        if (p.z > points[maxIndex[2]].z) maxIndex[2] = i;
+    }
+
+    size_t axis = 0;
+    float maxSpan = -1.0f;
+    for(size_t a = 0; a < 3; ++a)
+    {
+        vsg::vec3 d = points[maxIndex[a]] - points[minIndex[a]];
+        float span = vsg::dot(d, d);
+        if (span > maxSpan)
+        {
+            axis = a;
+            maxSpan = span;
+        }
+    }
+
+    vsg::vec3 center = (points[minIndex[axis]] + points[maxIndex[axis]]) * 0.5f;
+    float radius = std::sqrt(maxSpan) * 0.5f;
+
+    for(size_t i = 0; i < numPoints; ++i)
+    {
+        vsg::vec3 d = points[i] - center;
+        float distance2 = vsg::dot(d, d);
+        if (distance2 <= radius * radius) continue;
+
+        // move the center towards the point just far enough for the sphere to reach it while still enclosing the old sphere
+        float distance = std::sqrt(distance2);
+        float newRadius = (radius + distance) * 0.5f;
+        center = center + d * ((newRadius - radius) / distance);
+        radius = newRadius;
+    }
+
+    return vsg::sphere(center, radius);
+}
+
+vsg::sphere osg2vsg::mergeBoundingSpheres(const vsg::sphere& lhs, const vsg::sphere& rhs)
+{
+    if (rhs.radius < 0.0f) return lhs;
+    if (lhs.radius < 0.0f) return rhs;
+
+    vsg::vec3 d = rhs.center - lhs.center;
+    float distance = vsg::length(d);
+    if (distance + rhs.radius <= lhs.radius) return lhs;
+    if (distance + lhs.radius <= rhs.radius) return rhs;
+
+    float radius = (lhs.radius + distance + rhs.radius) * 0.5f;
+    return vsg::sphere(lhs.center + d * ((radius - lhs.radius) / distance), radius);
+}
+
+std::vector<uint32_t> osg2vsg::simplifyMesh(const std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, size_t targetIndexCount, float* resultError)
+{
+    std::vector<uint32_t> result(indices.begin(), indices.begin() + (indices.size() / 3) * 3);
+    if (resultError) *resultError = 0.0f;
+
+    uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+    // lock the vertices on open borders, whose edges are used by a single triangle, and the vertices that share their position with another
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeCounts;
+        for(size_t i = 0; i < result.size(); i += 3)
+        {
+            for(size_t c = 0; c < 3; ++c)
+            {
+                uint32_t a = result[i + c], b = result[i + (c + 1) % 3];
+                ++edgeCounts[std::make_pair(std::min(a, b), std::max(a, b))];
+            }
+        }
+
+        for(auto& [edge, count] : edgeCounts)
+        {
+            if (count == 1) locked[edge.first] = locked[edge.second] = true;
+        }
+
+        std::map<std::tuple<float, float, float>, uint32_t> positionVertices;
+        for(uint32_t v = 0; v < vertexCount; ++v)
+        {
+            auto [itr, inserted] = positionVertices.emplace(std::make_tuple(positions[v].x, positions[v].y, positions[v].z), v);
+            if (!inserted) locked[v] = locked[itr->second] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for(size_t i = 0; i < result.size(); i += 3)
+    {
+        auto& p0 = positions[result[i]];
+        vsg::vec3 normal = vsg::cross(positions[result[i + 1]] - p0, positions[result[i + 2]] - p0);
+        float area = vsg::length(normal);
+        if (area == 0.0f) continue;
+
+        normal = normal / area;
+        double d = -vsg::dot(normal, p0);
+        for(size_t c = 0; c < 3; ++c) quadrics[result[i + c]].addPlane(normal.x, normal.y, normal.z, d, area);
+    }
+
+    // collapse in passes, each applying the cheapest collapses that don't touch a vertex already moved in the pass, then removing the collapsed triangles
+    double maxError = 0.0;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    while(result.size() > targetIndexCount)
+    {
+        std::vector<Collapse> collapses;
+        collapses.reserve(result.size() * 2);
+        for(size_t i = 0; i < result.size(); i += 3)
+        {
+            for(size_t c = 0; c < 3; ++c)
+            {
+                uint32_t a = result[i + c], b = result[i + (c + 1) % 3];
+                if (!locked[a]) collapses.push_back(Collapse{a, b, quadrics[a].error(positions[b])});
+                if (!locked[b]) collapses.push_back(Collapse{b, a, quadrics[b].error(positions[a])});
+            }
+        }
+        if (collapses.empty()) break;
+
+        std::sort(collapses.begin(), collapses.end());
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for(auto index : result) ++adjacencyOffsets[index + 1];
+        for(uint32_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for(uint32_t i = 0; i < result.size(); ++i) adjacency[fill[result[i]]++] = i / 3;
+        }
+
+        for(uint32_t v = 0; v < vertexCount; ++v) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+        size_t trianglesRemoved = 0;
+        for(auto& collapse : collapses)
+        {
+            if (trianglesRemoved >= trianglesToRemove) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+
+            // reject collapses that would flip, or fold steeply, the remaining triangles around the vertex
+            bool flips = false;
+            size_t numCollapsed = 0;
+            for(uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+            {
+                const uint32_t* triangle = &result[adjacency[a] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    ++numCollapsed;
+                    continue;
+                }
+
+                vsg::vec3 p[3], moved[3];
+                for(size_t c = 0; c < 3; ++c)
+                {
+                    p[c] = positions[triangle[c]];
+                    moved[c] = (triangle[c] == collapse.from) ? positions[collapse.to] : p[c];
+                }
+
+                vsg::vec3 before = vsg::cross(p[1] - p[0], p[2] - p[0]);
+                vsg::vec3 after = vsg::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = vsg::dot(before, after) <= 0.25f * vsg::length(before) * vsg::length(after);
+            }
+            if (flips) continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+
+            // the triangles around the vertex have been checked against this collapse only, so keep their vertices in place for the rest of the pass
+            touched[collapse.to] = true;
+            for(uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+            {
+                const uint32_t* triangle = &result[adjacency[a] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+
+            maxError = std::max(maxError, collapse.error);
+            trianglesRemoved += numCollapsed;
+        }
+
+        if (trianglesRemoved == 0) break;
+
+        size_t numIndices = 0;
+        for(size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+
+            result[numIndices++] = a;
+            result[numIndices++] = b;
+            result[numIndices++] = c;
+        }
+        result.resize(numIndices);
+    }
+
+    if (resultError) *resultError = static_cast<float>(std::sqrt(maxError));
+
+    return result;
+}
+
+Clusters osg2vsg::buildClusters(std::vector<uint32_t>& indices, const std::vector<vsg::vec3>& positions, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    Clusters clusters;
+
+    uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+    if (numTriangles == 0 || maxVertices < 3 || maxTriangles == 0) return clusters;
+
+    uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+    // triangles adjacent to each vertex
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for(uint32_t i = 0; i < numTriangles * 3; ++i) ++adjacencyOffsets[indices[i] + 1];
+    for(uint32_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+    std::vector<uint32_t> adjacency(numTriangles * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(uint32_t i = 0; i < numTriangles * 3; ++i) adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<uint32_t> vertexCluster(vertexCount, invalidIndex);
+    std::vector<uint32_t> clusterVertices;
+    clusterVertices.reserve(maxVertices);
+
+    std::vector<uint32_t> result;
+    result.reserve(numTriangles * 3);
+
+    vsg::vec3 clusterSum(0.0f, 0.0f, 0.0f);
+    uint32_t clusterStart = 0;
+    uint32_t clusterTriangles = 0;
+    uint32_t nextSeed = 0;
+
+    auto newVertices = [&](uint32_t t) {
+        uint32_t count = 0;
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            if (vertexCluster[indices[t * 3 + i]] != clusters.size()) ++count;
+        }
+        return count;
+    };
+
+    auto closeCluster = [&]() {
+        Cluster cluster = computeClusterBounds(result.data() + clusterStart, static_cast<uint32_t>(result.size()) - clusterStart, positions);
+        cluster.firstIndex = clusterStart;
+        clusters.push_back(cluster);
+
+        clusterStart = static_cast<uint32_t>(result.size());
+        clusterTriangles = 0;
+        clusterVertices.clear();
+        clusterSum = vsg::vec3(0.0f, 0.0f, 0.0f);
+    };
+
+    for(uint32_t n = 0; n < numTriangles; ++n)
+    {
+        // grow the cluster with the adjacent triangle that adds fewest vertices, breaking ties by distance to the cluster's centroid to
+        // keep the cluster compact, otherwise start from the next triangle in the original order
+        uint32_t best = invalidIndex;
+        uint32_t bestNewVertices = 4;
+        float bestDistance = std::numeric_limits<float>::max();
+        vsg::vec3 centroid = clusterVertices.empty() ? vsg::vec3(0.0f, 0.0f, 0.0f) : clusterSum / float(clusterVertices.size());
+        for(auto v : clusterVertices)
+        {
+            for(uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                if (emitted[t]) continue;
+
+                uint32_t count = newVertices(t);
+                if (count > bestNewVertices) continue;
+
+                vsg::vec3 triangleCenter = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+                float distance = vsg::length(triangleCenter - centroid);
+                if (count < bestNewVertices || distance < bestDistance)
+                {
+                    best = t;
+                    bestNewVertices = count;
+                    bestDistance = distance;
+                }
+            }
+        }
+
+        if (best == invalidIndex)
+        {
+            while(emitted[nextSeed]) ++nextSeed;
+            best = nextSeed;
+            bestNewVertices = newVertices(best);
+        }
+
+        if (clusterTriangles > 0 && (clusterTriangles == maxTriangles || clusterVertices.size() + bestNewVertices > maxVertices))
+        {
+            // the triangle chosen for the full cluster seeds the next one
+            closeCluster();
+        }
+
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            uint32_t v = indices[best * 3 + i];
+            result.push_back(v);
+            if (vertexCluster[v] != clusters.size())
+            {
+                vertexCluster[v] = static_cast<uint32_t>(clusters.size());
+                clusterVertices.push_back(v);
+                clusterSum += positions[v];
+            }
+        }
+
+        emitted[best] = true;
+        ++clusterTriangles;
+    }
+
+    closeCluster();
+
+    // keep any trailing indices that don't form a whole triangle
+    result.insert(result.end(), indices.begin() + numTriangles * 3, indices.end());
+    indices.swap(result);
+
+    return clusters;
+}
+
+namespace
+{
+    // the per vertex data of an array being welded, float arrays compare their components to within the weld tolerance
+    struct WeldArray
+    {
+        const uint8_t* data;
+        uint32_t stride;
+        uint32_t numFloats;
+    };
+
+    // a copy of array with count values of the same type, null for the types that convertToVsg(osg::Geometry*) doesn't create
+    vsg::ref_ptr<vsg::Data> createArrayLike(const vsg::Data* array, uint32_t count)
+    {
+        if (dynamic_cast<const vsg::floatArray*>(array)) return vsg::floatArray::create(count);
+        if (dynamic_cast<const vsg::vec2Array*>(array)) return vsg::vec2Array::create(count);
+        if (dynamic_cast<const vsg::vec3Array*>(array)) return vsg::vec3Array::create(count);
+        if (dynamic_cast<const vsg::vec4Array*>(array)) return vsg::vec4Array::create(count);
+        if (dynamic_cast<const vsg::svec2Array*>(array)) return vsg::svec2Array::create(count);
+        if (dynamic_cast<const vsg::svec4Array*>(array)) return vsg::svec4Array::create(count);
+        if (dynamic_cast<const vsg::ubvec4Array*>(array)) return vsg::ubvec4Array::create(count);
+        if (dynamic_cast<const vsg::usvec2Array*>(array)) return vsg::usvec2Array::create(count);
+        return {};
+    }
+
+    uint32_t numFloatComponents(const vsg::Data* array)
+    {
+        if (dynamic_cast<const vsg::floatArray*>(array)) return 1;
+        if (dynamic_cast<const vsg::vec2Array*>(array)) return 2;
+        if (dynamic_cast<const vsg::vec3Array*>(array)) return 3;
+        if (dynamic_cast<const vsg::vec4Array*>(array)) return 4;
+        return 0;
+    }
+}
+
+uint32_t osg2vsg::weldVertices(std::vector<uint32_t>& indices, vsg::DataList& arrays, uint32_t vertexCount, float tolerance)
+{
+    if (vertexCount == 0 || indices.empty() || *std::max_element(indices.begin(), indices.end()) >= vertexCount) return vertexCount;
+
+    std::vector<WeldArray> weldArrays;
+    for(auto& array : arrays)
+    {
+        if (!array || array->valueCount() != vertexCount) continue;
+        if (!createArrayLike(array, 0)) return vertexCount;
+
+        uint32_t numFloats = tolerance > 0.0f ? numFloatComponents(array) : 0;
+        weldArrays.push_back(WeldArray{static_cast<const uint8_t*>(array->dataPointer()), static_cast<uint32_t>(array->valueSize()), numFloats});
+    }
+    if (weldArrays.empty()) return vertexCount;
+
+    // snap float components to a grid of tolerance spacing, so vertices within tolerance of each other usually share a key, though
+    // vertices either side of a grid line remain apart
+    float invTolerance = tolerance > 0.0f ? 1.0f / tolerance : 0.0f;
+    auto snap = [invTolerance](float value) { return static_cast<int64_t>(std::floor(value * invTolerance + 0.5f)); };
+
+    auto hashVertex = [&](uint32_t v)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 1099511628211ull; };
+        for(auto& weldArray : weldArrays)
+        {
+            const uint8_t* data = weldArray.data + size_t(v) * weldArray.stride;
+            if (weldArray.numFloats > 0)
+            {
+                const float* values = reinterpret_cast<const float*>(data);
+                for(uint32_t c = 0; c < weldArray.numFloats; ++c) mix(static_cast<uint64_t>(snap(values[c])));
+            }
+            else
+            {
+                for(uint32_t b = 0; b < weldArray.stride; ++b) mix(data[b]);
+            }
+        }
+        return hash;
+    };
+
+    auto equalVertices = [&](uint32_t lhs, uint32_t rhs)
+    {
+        for(auto& weldArray : weldArrays)
+        {
+            const uint8_t* lhs_data = weldArray.data + size_t(lhs) * weldArray.stride;
+            const uint8_t* rhs_data = weldArray.data + size_t(rhs) * weldArray.stride;
+            if (weldArray.numFloats > 0)
+            {
+                const float* lhs_values = reinterpret_cast<const float*>(lhs_data);
+                const float* rhs_values = reinterpret_cast<const float*>(rhs_data);
+                for(uint32_t c = 0; c < weldArray.numFloats; ++c)
+                {
+                    if (snap(lhs_values[c]) != snap(rhs_values[c])) return false;
+                }
+            }
+            else if (std::memcmp(lhs_data, rhs_data, weldArray.stride) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // open addressing hash table of the first vertex of each unique value, each vertex maps to the unique vertex it matches
+    size_t tableSize = 1;
+    while (tableSize < size_t(vertexCount) * 2) tableSize *= 2;
+    std::vector<uint32_t> table(tableSize, invalidIndex);
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint32_t> uniqueVertices;
+    for(uint32_t v = 0; v < vertexCount; ++v)
+    {
+        size_t slot = hashVertex(v) & (tableSize - 1);
+        while (table[slot] != invalidIndex && !equalVertices(uniqueVertices[table[slot]], v)) slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == invalidIndex)
+        {
+            table[slot] = static_cast<uint32_t>(uniqueVertices.size());
+            uniqueVertices.push_back(v);
+        }
+        remap[v] = table[slot];
+    }
+
+    uint32_t uniqueCount = static_cast<uint32_t>(uniqueVertices.size());
+    if (uniqueCount == vertexCount) return vertexCount;
+
+    // compact the per vertex arrays into new arrays, leaving the source arrays untouched as they may be shared through the ArrayCache
+    for(auto& array : arrays)
+    {
+        if (!array || array->valueCount() != vertexCount) continue;
+
+        auto welded = createArrayLike(array, uniqueCount);
+        size_t stride = array->valueSize();
+        const uint8_t* src = static_cast<const uint8_t*>(array->dataPointer());
+        uint8_t* dest = static_cast<uint8_t*>(welded->dataPointer());
+        for(uint32_t u = 0; u < uniqueCount; ++u)
+        {
+            std::memcpy(dest + u * stride, src + uniqueVertices[u] * stride, stride);
+        }
+        array = welded;
+    }
+
+    // remap the indices serially, geometries are already welded in parallel by the callers converting them on worker threads
+    for(auto& index : indices) index = remap[index];
+
+    return uniqueCount;
+}
+
+OptimizeMeshes::OptimizeMeshes(uint32_t in_numThreads) :
+    numThreads(in_numThreads)
+{
+}
+
+void OptimizeMeshes::apply(vsg::Object& object)
+{
+    if (_recording)
+    {
+        if (auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(&object))
+        {
+            if (_recording->ranges.empty()) _recording->instanceCount = drawIndexed->instanceCount;
+            else if (_recording->instanceCount != drawIndexed->instanceCount) _recording->supported = false;
+
+            _recording->ranges.push_back(Range{drawIndexed->firstIndex, drawIndexed->indexCount, drawIndexed->vertexOffset, currentTopology()});
+            return;
+        }
+
+        // any other command may draw the bound arrays in ways the ranges don't capture
+        if (dynamic_cast<vsg::Command*>(&object)) _recording->supported = false;
+    }
+
+    object.traverse(*this);
+}
+
+void OptimizeMeshes::apply(vsg::Group& group)
+{
+    // the cluster leaves of convertToClusters() bind their arrays in a vsg::Commands followed by a CullNode per cluster, the triangles of
+    // each cluster are kept within it so that the cluster bounds and cones stay valid
+    if (!_recording && group.getObject("Clusters"))
+    {
+        if (!_visited.insert(&group).second) return;
+
+        Recorded recorded;
+        _recording = &recorded;
+        group.traverse(*this);
+        _recording = nullptr;
+
+        addRecorded(recorded);
+        return;
+    }
+
+    group.traverse(*this);
+}
+
+void OptimizeMeshes::apply(vsg::StateGroup& stategroup)
+{
+    // track whether the pipeline drawing the subgraph blends, as only opaque meshes are reordered for overdraw, and its topology,
+    // as only triangle lists are reordered
+    bool blended = _blended;
+    VkPrimitiveTopology topology = _topology;
+    for(auto& command : stategroup.getStateCommands())
+    {
+        auto bindGraphicsPipeline = dynamic_cast<vsg::BindGraphicsPipeline*>(command.get());
+        auto pipeline = bindGraphicsPipeline ? bindGraphicsPipeline->getPipeline() : nullptr;
+        if (!pipeline) continue;
+
+        _blended = false;
+        _topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        for(auto& pipelineState : pipeline->getPipelineStates())
+        {
+            if (auto inputAssemblyState = dynamic_cast<vsg::InputAssemblyState*>(pipelineState.get()))
+            {
+                _topology = inputAssemblyState->topology;
+            }
+
+            if (auto colorBlendState = dynamic_cast<vsg::ColorBlendState*>(pipelineState.get()))
+            {
+                for(auto& attachment : colorBlendState->getColorBlendAttachments())
+                {
+                    if (attachment.blendEnable) _blended = true;
+                }
+            }
+        }
+    }
+
+    stategroup.traverse(*this);
+
+    _blended = blended;
+    _topology = topology;
+}
+
+void OptimizeMeshes::apply(vsg::Commands& commands)
+{
+    if (_recording)
+    {
+        commands.traverse(*this);
+        return;
+    }
+
+    if (!_visited.insert(&commands).second) return;
+
+    Recorded recorded;
+    _recording = &recorded;
+    commands.traverse(*this);
+    _recording = nullptr;
+
+    addRecorded(recorded);
+}
+
+void OptimizeMeshes::apply(vsg::Geometry& geometry)
+{
+    if (!_visited.insert(&geometry).second) return;
+
+    // meshes split into several draws share their arrays and indices, each draw is a range of them
+    std::vector<Range> ranges;
+    uint32_t instanceCount = 1;
+    for(auto& command : geometry.commands)
+    {
+        auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(command.get());
+        if (!drawIndexed || (!ranges.empty() && drawIndexed->instanceCount != instanceCount))
+        {
+            ++numMeshesSkipped;
+            return;
+        }
+
+        instanceCount = drawIndexed->instanceCount;
+        ranges.push_back(Range{drawIndexed->firstIndex, drawIndexed->indexCount, drawIndexed->vertexOffset, currentTopology()});
+    }
+
+    addMesh(geometry.arrays, geometry.indices, ranges, instanceCount);
+}
+
+void OptimizeMeshes::apply(vsg::VertexIndexDraw& vid)
+{
+    if (!_visited.insert(&vid).second) return;
+
+    addMesh(vid.arrays, vid.indices, {Range{vid.firstIndex, vid.indexCount, vid.vertexOffset, currentTopology()}}, vid.instanceCount);
+}
+
+void OptimizeMeshes::apply(vsg::BindVertexBuffers& bvb)
+{
+    if (!_recording) return;
+
+    if (!_recording->arrays.empty()) _recording->supported = false;
+    _recording->arrays = bvb.getArrays();
+}
+
+void OptimizeMeshes::apply(vsg::BindIndexBuffer& bib)
+{
+    if (!_recording) return;
+
+    if (_recording->indices) _recording->supported = false;
+    _recording->indices = bib.getIndices();
+}
+
+void OptimizeMeshes::addRecorded(const Recorded& recorded)
+{
+    // commands that only bind or only draw, such as those binding and drawing the packed arenas, hold no mesh of their own
+    if (recorded.ranges.empty() || (recorded.arrays.empty() && !recorded.indices)) return;
+
+    if (!recorded.supported)
+    {
+        ++numMeshesSkipped;
+        return;
+    }
+
+    addMesh(recorded.arrays, recorded.indices, recorded.ranges, recorded.instanceCount);
+}
+
+void OptimizeMeshes::addMesh(const vsg::DataList& arrays, vsg::ref_ptr<vsg::Data> indices, std::vector<Range> ranges, uint32_t instanceCount)
+{
+    bool supportedIndices = dynamic_cast<vsg::ushortArray*>(indices.get()) || dynamic_cast<vsg::uintArray*>(indices.get());
+    bool supportedRanges = !ranges.empty();
+
+    // the ranges are reordered independently so mustn't overlap, and must lie within the indices
+    std::sort(ranges.begin(), ranges.end(), [](const Range& lhs, const Range& rhs) { return lhs.firstIndex < rhs.firstIndex; });
+    uint64_t rangesEnd = 0;
+    bool hasTriangles = false;
+    for(auto& range : ranges)
+    {
+        if (range.firstIndex < rangesEnd || range.vertexOffset < 0) supportedRanges = false;
+        rangesEnd = uint64_t(range.firstIndex) + range.indexCount;
+        if (range.topology == VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST && range.indexCount >= 3) hasTriangles = true;
+    }
+
+    // only the ranges drawn as triangle lists are optimized, meshes without any are skipped
+    if (arrays.empty() || !arrays.front() || !supportedIndices || !supportedRanges || !hasTriangles || rangesEnd > indices->valueCount())
+    {
+        ++numMeshesSkipped;
+        return;
+    }
+
+    Mesh mesh;
+    mesh.arrays = arrays;
+    mesh.indices = indices;
+    mesh.ranges = std::move(ranges);
+    mesh.instanceCount = instanceCount;
+    if (reduceOverdraw && !_blended) mesh.overdrawThreshold = overdrawThreshold;
+    _meshes.push_back(mesh);
+}
+
+void OptimizeMeshes::optimize()
+{
+    // meshes that share index arrays can't be optimized independently, and vertex arrays shared with other meshes mustn't be reordered
+    std::map<vsg::Data*, uint32_t> referenceCounts;
+    for(auto& mesh : _meshes)
+    {
+        ++referenceCounts[mesh.indices.get()];
+        for(auto& array : mesh.arrays) ++referenceCounts[array.get()];
+    }
+
+    std::vector<Mesh> meshes;
+    for(auto& mesh : _meshes)
+    {
+        uint32_t vertexCount = numVertices(mesh.arrays.front());
+
+        bool validIndices = referenceCounts[mesh.indices.get()] == 1;
+        if (validIndices)
+        {
+            std::vector<uint32_t> indices = dynamic_cast<vsg::ushortArray*>(mesh.indices.get()) ? readIndices<vsg::ushortArray>(mesh.indices) : readIndices<vsg::uintArray>(mesh.indices);
+            for(auto& range : mesh.ranges)
+            {
+                if (range.indexCount == 0) continue;
+
+                auto begin = indices.begin() + range.firstIndex;
+                uint64_t maxVertex = uint64_t(*std::max_element(begin, begin + range.indexCount)) + range.vertexOffset;
+                if (maxVertex >= vertexCount) validIndices = false;
+            }
+        }
+
+        if (!validIndices)
+        {
+            ++numMeshesSkipped;
+            continue;
+        }
+
+        // per instance arrays are padded to the instance count, so they can't be told apart from the per vertex arrays when instancing
+        mesh.reorderVertices = mesh.instanceCount == 1;
+
+        // ranges drawn from different vertex offsets address the vertices through different bases, which a single remap can't keep in range
+        for(auto& range : mesh.ranges)
+        {
+            if (range.vertexOffset != 0) mesh.reorderVertices = false;
+        }
+        for(auto& array : mesh.arrays)
+        {
+            // arrays held by the ArrayCache may be used by meshes converted later, outside this traversal
+            if (!array || referenceCounts[array.get()] > 1 || array->getObject("ArrayCache")) mesh.reorderVertices = false;
+        }
+
+        meshes.push_back(mesh);
+    }
+    _meshes.clear();
+
+    if (numThreads <= 1 || meshes.size() <= 1)
+    {
+        for(auto& mesh : meshes) optimizeMesh(mesh);
+    }
+    else
+    {
+        auto active = vsg::Active::create();
+        auto operationThreads = vsg::OperationThreads::create(std::min(numThreads, static_cast<uint32_t>(meshes.size())), active);
+        auto latch = vsg::Latch::create(static_cast<int>(meshes.size()));
+
+        for(auto& mesh : meshes)
+        {
+            operationThreads->queue->add(vsg::ref_ptr<OptimizeMeshOperation>(new OptimizeMeshOperation(mesh, latch)));
+        }
+
+        // wait until all the meshes have been optimized
+        latch->wait();
+
+        active->active = false;
+    }
+
+    for(auto& mesh : meshes)
+    {
+        ++numMeshesOptimized;
+        numTriangles += mesh.numTriangles;
+        numCacheMissesBefore += mesh.numCacheMissesBefore;
+        numCacheMissesAfter += mesh.numCacheMissesAfter;
+    }
+}
+
+void OptimizeMeshes::print(std::ostream& out) const
+{
+    out<<"OptimizeMeshes : optimized "<<numMeshesOptimized<<" meshes, skipped "<<numMeshesSkipped<<", "<<numTriangles<<" triangles"<<std::endl;
+    if (numTriangles > 0)
+    {
+        out<<"    ACMR before = "<<double(numCacheMissesBefore) / double(numTriangles)<<", after = "<<double(numCacheMissesAfter) / double(numTriangles)<<std::endl;
+    }
+}
@@ -3,6 +3,8 @@
 #include <osg2vsg/ImageUtils.h>
 #include <osg2vsg/GeometryUtils.h>
 #include <osg2vsg/ShaderUtils.h>
+#include <osg2vsg/MeshOptimizer.h>
+#include <osg2vsg/DrawIndexedIndirect.h>
 
 #include <vsg/nodes/MatrixTransform.h>
 #include <vsg/nodes/CullGroup.h>
@@ -10,6 +12,8 @@
 
 #include <osg/io_utils>
 
+#include <cmath>
+
 using namespace osg2vsg;
 
 #if 0
@@ -55,6 +59,13 @@ vsg::ref_ptr<vsg::BindGraphicsPipeline> PipelineCache::getOrCreateBindGraphicsPi
     auto descriptorSetLayout = vsg::DescriptorSetLayout::create(descriptorBindings);
     vsg::DescriptorSetLayouts descriptorSetLayouts{descriptorSetLayout};
 
+    // the bone matrices change per skinned geometry rather than per state so are bound in a set of their own
+    if ((shaderModeMask & SKINNING) && (geometryAttributesMask & BONES))
+    {
+        vsg::DescriptorSetLayoutBindings boneBindings{ { BONE_MATRICES_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr } };
+        descriptorSetLayouts.push_back(vsg::DescriptorSetLayout::create(boneBindings));
+    }
+
     vsg::PushConstantRanges pushConstantRanges
     {
         {VK_SHADER_STAGE_VERTEX_BIT, 0, 128} // projection and modelview matrices
@@ -65,45 +76,31 @@ vsg::ref_ptr<vsg::BindGraphicsPipeline> PipelineCache::getOrCreateBindGraphicsPi
     vsg::VertexInputState::Bindings vertexBindingsDescriptions;
     vsg::VertexInputState::Attributes vertexAttributeDescriptions;
 
-    // setup vertex array
-    {
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{vertexBindingIndex, sizeof(vsg::vec3), VK_VERTEX_INPUT_RATE_VERTEX});
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ VERTEX_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32B32_SFLOAT, 0});
-        vertexBindingIndex++;
-    }
+    auto vertexAttributes = computeVertexAttributes(geometryAttributesMask);
 
-    if (geometryAttributesMask & NORMAL)
-    {
-        VkVertexInputRate nrate = geometryAttributesMask & NORMAL_OVERALL ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{ vertexBindingIndex, sizeof(vsg::vec3), nrate});
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ NORMAL_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32B32_SFLOAT, 0 }); // normal as vec3
-        vertexBindingIndex++;
-    }
-    if (geometryAttributesMask & TANGENT)
-    {
-        VkVertexInputRate trate = geometryAttributesMask & TANGENT_OVERALL ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{ vertexBindingIndex, sizeof(vsg::vec4), trate });
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ TANGENT_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32B32A32_SFLOAT, 0 }); // tanget as vec4
-        vertexBindingIndex++;
-    }
-    if (geometryAttributesMask & COLOR)
-    {
-        VkVertexInputRate crate = geometryAttributesMask & COLOR_OVERALL ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{ vertexBindingIndex, sizeof(vsg::vec4), crate });
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ COLOR_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32B32A32_SFLOAT, 0 }); // color as vec4
-        vertexBindingIndex++;
-    }
-    if (geometryAttributesMask & TEXCOORD0)
+    if (geometryAttributesMask & INTERLEAVED)
     {
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{ vertexBindingIndex, sizeof(vsg::vec2), VK_VERTEX_INPUT_RATE_VERTEX });
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ TEXCOORD0_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32_SFLOAT, 0 }); // texcoord as vec2
+        // per vertex attributes share the first binding, packed in order
+        uint32_t offset = 0;
+        for(auto& attribute : vertexAttributes)
+        {
+            if (attribute.inputRate != VK_VERTEX_INPUT_RATE_VERTEX) continue;
+
+            vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{attribute.location, vertexBindingIndex, attribute.format, offset});
+            offset += attribute.size;
+        }
+
+        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{vertexBindingIndex, offset, VK_VERTEX_INPUT_RATE_VERTEX});
         vertexBindingIndex++;
     }
-    if (geometryAttributesMask & TRANSLATE)
+
+    // each remaining attribute gets a binding of its own
+    for(auto& attribute : vertexAttributes)
     {
-        VkVertexInputRate trate = geometryAttributesMask & TRANSLATE_OVERALL ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
-        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{ vertexBindingIndex, sizeof(vsg::vec3), trate });
-        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{ TRANSLATE_CHANNEL, vertexBindingIndex, VK_FORMAT_R32G32B32_SFLOAT, 0 }); // tanget as vec4
+        if ((geometryAttributesMask & INTERLEAVED) && attribute.inputRate == VK_VERTEX_INPUT_RATE_VERTEX) continue;
+
+        vertexBindingsDescriptions.push_back(VkVertexInputBindingDescription{vertexBindingIndex, attribute.stride, attribute.inputRate});
+        vertexAttributeDescriptions.push_back(VkVertexInputAttributeDescription{attribute.location, vertexBindingIndex, attribute.format, 0});
         vertexBindingIndex++;
     }
 
@@ -443,6 +440,28 @@ void SceneBuilder::apply(osg::Billboard& billboard)
 
 void SceneBuilder::apply(osg::Geometry& geometry)
 {
+    if (auto rigGeometry = dynamic_cast<osgAnimation::RigGeometry*>(&geometry); rigGeometry && (buildOptions->supportedShaderModeMask & SKINNING))
+    {
+        auto& skinned = skinnedGeometries[rigGeometry];
+        if (!skinned) skinned = createSkinnedGeometry(rigGeometry, getNodePath());
+
+        if (skinned)
+        {
+            uint32_t previousShaderModeMasks = nodeShaderModeMasks;
+            nodeShaderModeMasks |= SKINNING;
+            skinned->bindPoseGeometry->accept(*this);
+            nodeShaderModeMasks = previousShaderModeMasks;
+        }
+        else if (rigGeometry->getSourceGeometry())
+        {
+            DEBUG_OUTPUT<<"SceneBuilder::apply(osg::Geometry& geometry), drawing RigGeometry that can't be skinned in its bind pose"<<std::endl;
+            if (rigGeometry->getStateSet()) pushStateSet(*rigGeometry->getStateSet());
+            rigGeometry->getSourceGeometry()->accept(*this);
+            if (rigGeometry->getStateSet()) popStateSet();
+        }
+        return;
+    }
+
     if (!geometry.getVertexArray())
     {
         DEBUG_OUTPUT<<"SceneBuilder::apply(osg::Geometry& geometry), ignoring geometry with null geometry.getVertexArray()"<<std::endl;
@@ -506,6 +525,51 @@ void SceneBuilder::apply(osg::Geometry& geometry)
     if (geometry.getStateSet()) popStateSet();
 }
 
+void SceneBuilder::apply(osg::Drawable& drawable)
+{
+    auto text = dynamic_cast<osgText::Text*>(&drawable);
+    if (!text)
+    {
+        apply(static_cast<osg::Node&>(drawable));
+        return;
+    }
+
+    // the text's own state holds osgText's shaders, the atlas provides the glyph texture and blending in their place
+    if (!glyphAtlas) glyphAtlas = GlyphAtlas::create();
+
+    auto& batch = textBatches[statestack];
+    if (!batch) batch = TextBatch::create();
+
+    osg::Matrix matrix;
+    if (!matrixstack.empty()) matrix = matrixstack.back();
+
+    batch->add(*text, matrix, *glyphAtlas);
+}
+
+void SceneBuilder::addTextGeometries()
+{
+    if (textBatches.empty()) return;
+
+    // the batches are already in world coordinates, so are added as if found under the root with the states they were found under
+    StateStack savedStatestack;
+    MatrixStack savedMatrixstack;
+    std::swap(statestack, savedStatestack);
+    std::swap(matrixstack, savedMatrixstack);
+
+    for (auto& [stack, batch] : textBatches)
+    {
+        DEBUG_OUTPUT<<"SceneBuilder::addTextGeometries() batching "<<batch->numTexts()<<" texts"<<std::endl;
+
+        statestack = stack;
+        if (auto geometry = batch->createGeometry(*glyphAtlas)) apply(*geometry);
+    }
+
+    std::swap(statestack, savedStatestack);
+    std::swap(matrixstack, savedMatrixstack);
+
+    textBatches.clear();
+}
+
 void SceneBuilder::pushStateSet(osg::StateSet& stateset)
 {
     statestack.push_back(&stateset);
@@ -592,8 +656,11 @@ osg::ref_ptr<osg::Node> SceneBuilder::createTransformGeometryGraphOSG(TransformG
 
 osg::ref_ptr<osg::Node> SceneBuilder::createOSG()
 {
+    addTextGeometries();
+
     // clear caches
     geometriesMap.clear();
+    boundsMap.clear();
     texturesMap.clear();
 
     osg::ref_ptr<osg::Group> group = new osg::Group;
@@ -644,6 +711,120 @@ osg::ref_ptr<osg::Node> SceneBuilder::createOSG()
     return group;
 }
 
+void SceneBuilder::instanceGeometries(MasksTransformStateMap& masksMap)
+{
+    MasksTransformStateMap instancedMap;
+    for (auto& [masks, transformStatePair] : masksMap)
+    {
+        // billboards are already instanced by their per instance translations, and each skinned geometry has bone matrices of its own
+        if (masks.second & (TRANSLATE | TRANSLATE_OVERALL | INSTANCE_MATRIX | BONES)) continue;
+
+        for (auto& [stateset, transformGeometryMap] : transformStatePair.stateTransformMap)
+        {
+            std::map<osg::Geometry*, std::vector<osg::Matrix>> geometryMatrices;
+            for (auto& [matrix, geometries] : transformGeometryMap)
+            {
+                for (auto& geometry : geometries) geometryMatrices[geometry.get()].push_back(matrix);
+            }
+
+            for (auto& [geometry, matrices] : geometryMatrices)
+            {
+                if (matrices.size() < buildOptions->minInstances) continue;
+
+                osg::ref_ptr<osg::Geometry> instanced = createInstancedGeometry(geometry, matrices);
+                if (buildOptions->tightBounds)
+                {
+                    // the instances' spheres merged, computeBound() can't see the instance matrices in the vertex arrays
+                    vsg::sphere bound(vsg::vec3(0.0f, 0.0f, 0.0f), -1.0f);
+                    for (auto& matrix : matrices)
+                    {
+                        bound = mergeBoundingSpheres(bound, computeBound(Geometries{osg::ref_ptr<osg::Geometry>(geometry)}, matrix));
+                    }
+                    boundsMap[instanced.get()] = bound;
+                }
+
+                for (auto& matrix : matrices)
+                {
+                    auto& geometries = transformGeometryMap[matrix];
+                    geometries.erase(std::remove(geometries.begin(), geometries.end(), geometry), geometries.end());
+                }
+
+                instancedMap[Masks(masks.first, masks.second | INSTANCE_MATRIX)].stateTransformMap[stateset][osg::Matrix()].push_back(instanced);
+            }
+
+            for (auto itr = transformGeometryMap.begin(); itr != transformGeometryMap.end();)
+            {
+                if (itr->second.empty()) itr = transformGeometryMap.erase(itr);
+                else ++itr;
+            }
+        }
+    }
+
+    for (auto& [masks, transformStatePair] : instancedMap)
+    {
+        for (auto& [stateset, transformGeometryMap] : transformStatePair.stateTransformMap)
+        {
+            auto& geometries = masksMap[masks].stateTransformMap[stateset][osg::Matrix()];
+            geometries.insert(geometries.end(), transformGeometryMap[osg::Matrix()].begin(), transformGeometryMap[osg::Matrix()].end());
+        }
+    }
+}
+
+vsg::sphere SceneBuilder::computeBound(const osg::Geometry* geometry)
+{
+    if (!buildOptions->tightBounds)
+    {
+        osg::BoundingBox bb = geometry->getBoundingBox();
+        vsg::vec3 bb_min(bb.xMin(), bb.yMin(), bb.zMin());
+        vsg::vec3 bb_max(bb.xMax(), bb.yMax(), bb.zMax());
+        return vsg::sphere((bb_min + bb_max)*0.5f, vsg::length(bb_max - bb_min)*0.5f);
+    }
+
+    if (auto itr = boundsMap.find(geometry); itr != boundsMap.end()) return itr->second;
+
+    return boundsMap[geometry] = computeBoundingSphere(geometry);
+}
+
+vsg::sphere SceneBuilder::computeBound(const Geometries& geometries, const osg::Matrix& matrix)
+{
+    if (!buildOptions->tightBounds)
+    {
+        osg::BoundingBox overall_bb;
+        for (auto& geometry : geometries)
+        {
+            osg::BoundingBox bb = geometry->getBoundingBox();
+            for(int i=0; i<8; ++i)
+            {
+                overall_bb.expandBy(bb.corner(i) * matrix);
+            }
+        }
+
+        vsg::vec3 bb_min(overall_bb.xMin(), overall_bb.yMin(), overall_bb.zMin());
+        vsg::vec3 bb_max(overall_bb.xMax(), overall_bb.yMax(), overall_bb.zMax());
+        return vsg::sphere((bb_min + bb_max)*0.5f, vsg::length(bb_max - bb_min)*0.5f);
+    }
+
+    // transform the geometries' spheres and merge them, scaling the radii by the Frobenius norm of the matrix's 3x3, which bounds its
+    // largest stretch in any direction where the lengths of its rows or columns can fall short of it under shear
+    double scale = 0.0;
+    for(int r = 0; r < 3; ++r)
+    {
+        scale += osg::Vec3d(matrix(r, 0), matrix(r, 1), matrix(r, 2)).length2();
+    }
+    scale = std::sqrt(scale);
+
+    vsg::sphere bound(vsg::vec3(0.0f, 0.0f, 0.0f), -1.0f);
+    for (auto& geometry : geometries)
+    {
+        vsg::sphere local = computeBound(geometry);
+        if (local.radius < 0.0f) continue;
+
+        osg::Vec3d center = osg::Vec3d(local.center.x, local.center.y, local.center.z) * matrix;
+        bound = mergeBoundingSpheres(bound, vsg::sphere(vsg::vec3(center.x(), center.y(), center.z()), static_cast<float>(local.radius * scale)));
+    }
+    return bound;
+}
+
 vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformGeometryMap& transformGeometryMap, vsg::Paths& /*searchPaths*/, uint32_t requiredGeomAttributesMask)
 {
     DEBUG_OUTPUT << "createTransformGeometryGraphVSG() " << transformGeometryMap.size() << std::endl;
@@ -675,19 +856,7 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformG
 
             if (buildOptions->insertCullGroups || buildOptions->insertCullNodes)
             {
-                osg::BoundingBox overall_bb;
-                for (auto& geometry : geometries)
-                {
-                    osg::BoundingBox bb = geometry->getBoundingBox();
-                    for(int i=0; i<8; ++i)
-                    {
-                        overall_bb.expandBy(bb.corner(i) * matrix);
-                    }
-                }
-
-                vsg::vec3 bb_min(overall_bb.xMin(), overall_bb.yMin(), overall_bb.zMin());
-                vsg::vec3 bb_max(overall_bb.xMax(), overall_bb.yMax(), overall_bb.zMax());
-                vsg::sphere boundingSphere((bb_min + bb_max)*0.5f, vsg::length(bb_max - bb_min)*0.5f);
+                vsg::sphere boundingSphere = computeBound(geometries, matrix);
 
                 if (buildOptions->insertCullNodes)
                 {
@@ -750,7 +919,7 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformG
         for (auto& geometry : geometries)
         {
 #if 1
-            vsg::ref_ptr<vsg::Command> leaf;
+            vsg::ref_ptr<vsg::Node> leaf;
             if(geometriesMap.find(geometry) != geometriesMap.end())
             {
                 DEBUG_OUTPUT << "sharing geometry" << std::endl;
@@ -758,7 +927,7 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformG
             }
             else
             {
-                leaf = convertToVsg(geometry, requiredGeomAttributesMask, buildOptions->geometryTarget);
+                leaf = convertGeometry(geometry, requiredGeomAttributesMask);
                 if (leaf)
                 {
                     geometriesMap[geometry] = leaf;
@@ -767,11 +936,7 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformG
 
             if (requiresLeafCullGroup)
             {
-                osg::BoundingBox bb = geometry->getBoundingBox();
-                vsg::vec3 bb_min(bb.xMin(), bb.yMin(), bb.zMin());
-                vsg::vec3 bb_max(bb.xMax(), bb.yMax(), bb.zMax());
-
-                vsg::sphere boundingSphere((bb_min + bb_max)*0.5f, vsg::length(bb_max - bb_min)*0.5f);
+                vsg::sphere boundingSphere = computeBound(geometry);
                 if (buildOptions->insertCullNodes)
                 {
                     DEBUG_OUTPUT<<"Using CullNode"<<std::endl;
@@ -831,12 +996,343 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createTransformGeometryGraphVSG(TransformG
     return group;
 }
 
+namespace
+{
+    // number of vertices in a converted vertex array, interleaved arrays hold one row per vertex
+    uint32_t numVertices(const vsg::Data* array)
+    {
+        if (auto interleaved = dynamic_cast<const vsg::ubyteArray2D*>(array)) return interleaved->height();
+        return static_cast<uint32_t>(array->valueCount());
+    }
+
+    template<class A>
+    void copyIndices(const vsg::Data* indices, uint32_t* dest)
+    {
+        auto src = static_cast<const typename A::value_type*>(indices->dataPointer());
+        std::copy(src, src + indices->valueCount(), dest);
+    }
+}
+
+vsg::ref_ptr<vsg::Commands> SceneBuilder::packArenas(const ConvertedGeometries& convertedGeometries, GeometriesMap& leaves)
+{
+    if (convertedGeometries.empty() || !convertedGeometries.front().second) return {};
+
+    // check that every geometry has the same vertex bindings, per vertex arrays only, and is drawn with non instanced DrawIndexed
+    size_t numBindings = convertedGeometries.front().second->arrays.size();
+    std::vector<size_t> arenaSizes(numBindings, 0);
+    uint32_t numIndices = 0;
+    bool shortIndices = true;
+    for (auto& [osg_geometry, geometry] : convertedGeometries)
+    {
+        if (!geometry || !geometry->indices || geometry->arrays.size() != numBindings) return {};
+
+        for (size_t i = 0; i < numBindings; ++i)
+        {
+            auto& array = geometry->arrays[i];
+            if (!array || numVertices(array) != numVertices(geometry->arrays.front())) return {};
+            arenaSizes[i] += array->dataSize();
+        }
+
+        for (auto& command : geometry->commands)
+        {
+            auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(command.get());
+            if (!drawIndexed || drawIndexed->instanceCount != 1) return {};
+        }
+
+        if (dynamic_cast<vsg::uintArray*>(geometry->indices.get())) shortIndices = false;
+        else if (!dynamic_cast<vsg::ushortArray*>(geometry->indices.get())) return {};
+
+        numIndices += static_cast<uint32_t>(geometry->indices->valueCount());
+    }
+
+    vsg::DataList vertexArenas;
+    for (auto size : arenaSizes) vertexArenas.push_back(vsg::ubyteArray::create(static_cast<uint32_t>(size)));
+
+    // indices are relative to each geometry's base vertex so 16 bit indices stay 16 bit, only mixed arenas are promoted to 32 bit
+    std::vector<uint32_t> indices(numIndices);
+
+    std::vector<size_t> arenaOffsets(numBindings, 0);
+    uint32_t baseVertex = 0;
+    uint32_t baseIndex = 0;
+    for (auto& [osg_geometry, geometry] : convertedGeometries)
+    {
+        for (size_t i = 0; i < numBindings; ++i)
+        {
+            auto& array = geometry->arrays[i];
+            std::memcpy(static_cast<uint8_t*>(vertexArenas[i]->dataPointer()) + arenaOffsets[i], array->dataPointer(), array->dataSize());
+            arenaOffsets[i] += array->dataSize();
+        }
+
+        if (dynamic_cast<vsg::ushortArray*>(geometry->indices.get())) copyIndices<vsg::ushortArray>(geometry->indices, indices.data() + baseIndex);
+        else copyIndices<vsg::uintArray>(geometry->indices, indices.data() + baseIndex);
+
+        vsg::ref_ptr<vsg::Node> leaf;
+        if (geometry->commands.size() == 1)
+        {
+            auto drawIndexed = static_cast<vsg::DrawIndexed*>(geometry->commands.front().get());
+            leaf = vsg::DrawIndexed::create(drawIndexed->indexCount, 1, baseIndex + drawIndexed->firstIndex, static_cast<int32_t>(baseVertex) + drawIndexed->vertexOffset, 0);
+        }
+        else
+        {
+            auto commands = vsg::Commands::create();
+            for (auto& command : geometry->commands)
+            {
+                auto drawIndexed = static_cast<vsg::DrawIndexed*>(command.get());
+                commands->addChild(vsg::DrawIndexed::create(drawIndexed->indexCount, 1, baseIndex + drawIndexed->firstIndex, static_cast<int32_t>(baseVertex) + drawIndexed->vertexOffset, 0));
+            }
+            leaf = commands;
+        }
+        leaves[osg_geometry] = leaf;
+
+        baseVertex += numVertices(geometry->arrays.front());
+        baseIndex += static_cast<uint32_t>(geometry->indices->valueCount());
+    }
+
+    vsg::ref_ptr<vsg::Data> indexArena;
+    if (shortIndices)
+    {
+        auto shortArena = vsg::ushortArray::create(numIndices);
+        std::copy(indices.begin(), indices.end(), static_cast<uint16_t*>(shortArena->dataPointer()));
+        indexArena = shortArena;
+    }
+    else
+    {
+        auto intArena = vsg::uintArray::create(numIndices);
+        std::copy(indices.begin(), indices.end(), static_cast<uint32_t*>(intArena->dataPointer()));
+        indexArena = intArena;
+    }
+
+    auto bindArenas = vsg::Commands::create();
+    bindArenas->addChild(vsg::BindVertexBuffers::create(0, vertexArenas));
+    bindArenas->addChild(vsg::BindIndexBuffer::create(indexArena));
+    return bindArenas;
+}
+
+vsg::ref_ptr<vsg::Node> SceneBuilder::createIndirectGeometryGraphVSG(TransformGeometryMap& transformGeometryMap)
+{
+    if (transformGeometryMap.empty()) return {};
+
+    // collect the draws at offsets into the arenas that packArenas() assigned to each geometry
+    auto collectDraws = [&](const osg::Geometry* geometry, std::vector<vsg::DrawIndexed*>& drawIndexedList)
+    {
+        auto itr = geometriesMap.find(geometry);
+        if (itr == geometriesMap.end()) return false;
+
+        if (auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(itr->second.get()))
+        {
+            drawIndexedList.push_back(drawIndexed);
+            return true;
+        }
+
+        auto commands = dynamic_cast<vsg::Commands*>(itr->second.get());
+        if (!commands) return false;
+
+        for (auto& child : commands->getChildren())
+        {
+            auto drawIndexed = dynamic_cast<vsg::DrawIndexed*>(child.get());
+            if (!drawIndexed) return false;
+            drawIndexedList.push_back(drawIndexed);
+        }
+        return true;
+    };
+
+    vsg::ref_ptr<vsg::Group> group = vsg::Group::create();
+    for (auto& [matrix, geometries] : transformGeometryMap)
+    {
+        vsg::mat4 vsgmatrix = vsg::mat4(matrix(0, 0), matrix(0, 1), matrix(0, 2), matrix(0, 3),
+                                        matrix(1, 0), matrix(1, 1), matrix(1, 2), matrix(1, 3),
+                                        matrix(2, 0), matrix(2, 1), matrix(2, 2), matrix(2, 3),
+                                        matrix(3, 0), matrix(3, 1), matrix(3, 2), matrix(3, 3));
+
+        std::vector<uint32_t> draws;
+        std::vector<vsg::vec4> objects;
+        for (auto& geometry : geometries)
+        {
+            std::vector<vsg::DrawIndexed*> drawIndexedList;
+            if (!collectDraws(geometry.get(), drawIndexedList)) return {};
+
+            vsg::sphere bound = computeBound(geometry.get());
+            for (auto drawIndexed : drawIndexedList)
+            {
+                draws.insert(draws.end(), {drawIndexed->indexCount, drawIndexed->instanceCount, drawIndexed->firstIndex, static_cast<uint32_t>(drawIndexed->vertexOffset), drawIndexed->firstInstance});
+
+                objects.push_back(vsg::vec4(bound.center.x, bound.center.y, bound.center.z, bound.radius));
+                for (int c = 0; c < 4; ++c) objects.push_back(vsgmatrix[c]);
+            }
+        }
+
+        if (draws.empty()) continue;
+
+        auto drawArray = vsg::uintArray::create(static_cast<uint32_t>(draws.size()));
+        std::copy(draws.begin(), draws.end(), static_cast<uint32_t*>(drawArray->dataPointer()));
+
+        auto objectArray = vsg::vec4Array::create(static_cast<uint32_t>(objects.size()));
+        std::copy(objects.begin(), objects.end(), static_cast<vsg::vec4*>(objectArray->dataPointer()));
+
+        auto drawIndexedIndirect = DrawIndexedIndirect::create(drawArray, objectArray);
+        drawIndexedIndirect->multiDrawIndirect = buildOptions->multiDrawIndirect;
+
+        vsg::ref_ptr<vsg::Node> node = drawIndexedIndirect;
+        if (!matrix.isIdentity())
+        {
+            auto transform = vsg::MatrixTransform::create(vsgmatrix);
+            transform->addChild(node);
+            node = transform;
+        }
+
+        // the individual draws are no longer culled on the CPU so cull the draws of each transform as a whole
+        if (buildOptions->insertCullGroups || buildOptions->insertCullNodes)
+        {
+            vsg::sphere boundingSphere = computeBound(geometries, matrix);
+            if (buildOptions->insertCullNodes)
+            {
+                node = vsg::CullNode::create(boundingSphere, node);
+            }
+            else
+            {
+                auto cullGroup = vsg::CullGroup::create(boundingSphere);
+                cullGroup->addChild(node);
+                node = cullGroup;
+            }
+        }
+
+        group->addChild(node);
+    }
+
+    if (group->getNumChildren() == 0) return {};
+    if (group->getNumChildren() == 1) return vsg::ref_ptr<vsg::Node>(group->getChild(0));
+
+    return group;
+}
+
+namespace
+{
+    struct ConvertGeometryJob
+    {
+        osg::Geometry* geometry;
+        uint32_t geometrymask;
+        vsg::ref_ptr<vsg::Node> leaf;
+    };
+
+    struct ConvertGeometryOperation : public vsg::Operation
+    {
+        ConvertGeometryOperation(const SceneBuilder& in_builder, std::vector<ConvertGeometryJob>& in_jobs, std::atomic<size_t>& in_next, vsg::ref_ptr<vsg::Latch> in_latch) :
+            builder(in_builder),
+            jobs(in_jobs),
+            next(in_next),
+            latch(in_latch) {}
+
+        void run() override
+        {
+            // take jobs until none are left so that threads finishing cheap geometries move on to the remaining ones
+            for (size_t i = next++; i < jobs.size(); i = next++)
+            {
+                jobs[i].leaf = builder.convertGeometry(jobs[i].geometry, jobs[i].geometrymask);
+            }
+            latch->count_down();
+        }
+
+        const SceneBuilder& builder;
+        std::vector<ConvertGeometryJob>& jobs;
+        std::atomic<size_t>& next;
+        vsg::ref_ptr<vsg::Latch> latch;
+    };
+}
+
+std::pair<uint32_t, uint32_t> SceneBuilder::computePipelineMasks(const Masks& masks) const
+{
+    // the INSTANCE_MATRIX layout flag set by instanceGeometries() isn't one of the supportedGeometryAttributes so is carried over separately
+    uint32_t geometrymask = ((masks.second | buildOptions->overrideGeomAttributes) & buildOptions->supportedGeometryAttributes) | (masks.second & INSTANCE_MATRIX);
+    uint32_t shaderModeMask = (masks.first | buildOptions->overrideShaderModeMask) & buildOptions->supportedShaderModeMask;
+    if (shaderModeMask & NORMAL_MAP) geometrymask |= TANGENT; // mesh propably won't have tangets so force them on if we want Normal mapping
+    if (buildOptions->stripUnusedAttributes && buildOptions->vertexShaderPath.empty() && buildOptions->fragmentShaderPath.empty()) geometrymask = stripUnusedGeometryAttributes(shaderModeMask, geometrymask);
+    if (buildOptions->interleaveVertexArrays) geometrymask |= INTERLEAVED;
+    if (buildOptions->quantizeVertexAttributes) geometrymask |= QUANTIZED;
+    return {shaderModeMask, geometrymask};
+}
+
+bool SceneBuilder::usesArenas(uint32_t geometrymask) const
+{
+    // the LOD and cluster subgraphs are built by convertGeometry() so pipelines converted with them aren't packed
+    if (buildOptions->generateLODs || buildOptions->generateClusters) return false;
+
+    return buildOptions->packArenas && (geometrymask & (NORMAL_OVERALL | TANGENT_OVERALL | COLOR_OVERALL | TRANSLATE | TRANSLATE_OVERALL | BONES)) == 0;
+}
+
+vsg::ref_ptr<vsg::Node> SceneBuilder::convertGeometry(osg::Geometry* geometry, uint32_t requiredGeomAttributesMask) const
+{
+    // the LOD ranges and cluster bounds are computed from the vertices so wouldn't follow skinned geometries as they deform
+    bool deforms = (requiredGeomAttributesMask & BONES) != 0;
+
+    vsg::ref_ptr<vsg::Node> leaf;
+    if (buildOptions->generateLODs && !deforms) leaf = convertToLOD(geometry, requiredGeomAttributesMask, buildOptions->geometryOptions);
+    if (!leaf && buildOptions->generateClusters && !deforms) leaf = convertToClusters(geometry, requiredGeomAttributesMask, buildOptions->geometryOptions);
+    if (!leaf) leaf = convertToVsg(geometry, requiredGeomAttributesMask, buildOptions->geometryTarget, buildOptions->geometryOptions);
+    return createRelativeToCenterTransform(geometry, leaf, buildOptions->geometryOptions);
+}
+
+void SceneBuilder::convertGeometries(const MasksTransformStateMap& masksMap)
+{
+    // each geometry is converted once, for the first pipeline that uses it, matching the sharing through geometriesMap when built serially.
+    // Geometries of pipelines packed into arenas are converted by createVSG() itself.
+    std::vector<ConvertGeometryJob> jobs;
+    std::set<const osg::Geometry*> queued;
+    for (auto& [masks, transformStatePair] : masksMap)
+    {
+        auto geometrymask = computePipelineMasks(masks).second;
+        if (usesArenas(geometrymask)) continue;
+
+        for (auto& stateTransform : transformStatePair.stateTransformMap)
+        {
+            for (auto& [matrix, geometries] : stateTransform.second)
+            {
+                for (auto& geometry : geometries)
+                {
+                    if (geometriesMap.count(geometry.get()) || !queued.insert(geometry.get()).second) continue;
+                    jobs.push_back(ConvertGeometryJob{geometry.get(), geometrymask, {}});
+                }
+            }
+        }
+    }
+
+    uint32_t numThreads = std::min(buildOptions->numThreads, static_cast<uint32_t>(jobs.size()));
+    if (numThreads <= 1)
+    {
+        for (auto& job : jobs) job.leaf = convertGeometry(job.geometry, job.geometrymask);
+    }
+    else
+    {
+        auto active = vsg::Active::create();
+        auto operationThreads = vsg::OperationThreads::create(numThreads, active);
+        auto latch = vsg::Latch::create(static_cast<int>(numThreads));
+
+        std::atomic<size_t> next{0};
+        for (uint32_t i = 0; i < numThreads; ++i)
+        {
+            operationThreads->queue->add(vsg::ref_ptr<ConvertGeometryOperation>(new ConvertGeometryOperation(*this, jobs, next, latch)));
+        }
+
+        // wait until all the geometries have been converted
+        latch->wait();
+
+        active->active = false;
+    }
+
+    for (auto& job : jobs)
+    {
+        if (job.leaf) geometriesMap[job.geometry] = job.leaf;
+    }
+}
+
 vsg::ref_ptr<vsg::Node> SceneBuilder::createVSG(vsg::Paths& searchPaths)
 {
     DEBUG_OUTPUT<<"SceneBuilder::createVSG(vsg::Paths& searchPaths)"<<std::endl;
 
+    addTextGeometries();
+
     // clear caches
     geometriesMap.clear();
+    boundsMap.clear();
     texturesMap.clear();
 
     vsg::ref_ptr<vsg::Group> group = vsg::Group::create();
@@ -847,7 +1343,36 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createVSG(vsg::Paths& searchPaths)
     vsg::ref_ptr<vsg::Group> transparentGroup = vsg::Group::create();
     group->addChild(transparentGroup);
 
-    for (auto[masks, transformStatePair] : masksTransformStateMap)
+    MasksTransformStateMap buildMasksTransformStateMap = masksTransformStateMap;
+    if (buildOptions->instanceGeometries) instanceGeometries(buildMasksTransformStateMap);
+
+    if (buildOptions->batchGeometries)
+    {
+        for (auto& [masks, transformStatePair] : buildMasksTransformStateMap)
+        {
+            // skinned geometries can't be merged as each binds its own bone matrices
+            if (masks.second & BONES) continue;
+
+            for (auto& stateTransform : transformStatePair.stateTransformMap)
+            {
+                for (auto& [matrix, geometries] : stateTransform.second)
+                {
+                    geometries = osg2vsg::batchGeometries(geometries, buildOptions->batchCellSize, buildOptions->batchMaxVertices);
+                }
+            }
+        }
+    }
+
+    // convert the geometries up front so that building the graph below only links the converted leaves
+    convertGeometries(buildMasksTransformStateMap);
+
+    std::map<const osg::Geometry*, vsg::ref_ptr<SkinnedGeometry>> bindPoseSkinnedGeometries;
+    for (auto& [rigGeometry, skinned] : skinnedGeometries)
+    {
+        if (skinned) bindPoseSkinnedGeometries[skinned->bindPoseGeometry.get()] = skinned;
+    }
+
+    for (auto[masks, transformStatePair] : buildMasksTransformStateMap)
     {
         unsigned int maxNumDescriptors = transformStatePair.stateTransformMap.size();
         if (maxNumDescriptors==0)
@@ -860,9 +1385,7 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createVSG(vsg::Paths& searchPaths)
             DEBUG_OUTPUT<<"  maxNumDescriptors = "<<maxNumDescriptors<<std::endl;
         }
 
-        uint32_t geometrymask = (masks.second | buildOptions->overrideGeomAttributes) & buildOptions->supportedGeometryAttributes;
-        uint32_t shaderModeMask = (masks.first | buildOptions->overrideShaderModeMask) & buildOptions->supportedShaderModeMask;
-        if (shaderModeMask & NORMAL_MAP) geometrymask |= TANGENT; // mesh propably won't have tangets so force them on if we want Normal mapping
+        auto [shaderModeMask, geometrymask] = computePipelineMasks(masks);
 
         DEBUG_OUTPUT<<"  about to call createStateSetWithGraphicsPipeline("<<shaderModeMask<<", "<<geometrymask<<", "<<maxNumDescriptors<<")"<<std::endl;
 
@@ -886,9 +1409,83 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createVSG(vsg::Paths& searchPaths)
             opaqueGroup->addChild(graphicsPipelineGroup);
         }
 
+        // convert all the geometries of the pipeline up front so their arrays can be packed into arenas, bound once ahead of the
+        // subgraphs, with the geometriesMap leaves becoming draws at offsets into the arenas
+        std::set<const osg::Geometry*> arenaGeometries;
+        bool arenasPacked = false;
+        if (usesArenas(geometrymask))
+        {
+            ConvertedGeometries convertedGeometries;
+            OptimizeMeshes optimizeMeshes;
+            optimizeMeshes.reduceOverdraw = buildOptions->reduceOverdraw && !(shaderModeMask & BLEND);
+            for (auto& stateTransform : transformStatePair.stateTransformMap)
+            {
+                for (auto& [matrix, geometries] : stateTransform.second)
+                {
+                    for (auto& geometry : geometries)
+                    {
+                        if (!arenaGeometries.insert(geometry.get()).second) continue;
+
+                        auto command = convertToVsg(geometry, geometrymask, VSG_GEOMETRY, buildOptions->geometryOptions);
+                        vsg::ref_ptr<vsg::Geometry> converted(dynamic_cast<vsg::Geometry*>(command.get()));
+                        convertedGeometries.emplace_back(geometry.get(), converted);
+                        if (converted && buildOptions->optimizeMeshes) converted->accept(optimizeMeshes);
+                    }
+                }
+            }
+
+            // the draws at offsets into the arenas no longer carry arrays so optimize the meshes before they are packed
+            if (buildOptions->optimizeMeshes) optimizeMeshes.optimize();
+
+            if (auto bindArenas = packArenas(convertedGeometries, geometriesMap))
+            {
+                graphicsPipelineGroup->addChild(bindArenas);
+                arenasPacked = true;
+            }
+
+            for (auto& geometry : arenaGeometries)
+            {
+                if (auto itr = geometriesMap.find(geometry); itr != geometriesMap.end())
+                {
+                    itr->second = createRelativeToCenterTransform(geometry, itr->second, buildOptions->geometryOptions);
+                }
+            }
+        }
+
+        // wrap the leaves of skinned geometries in the binding of their bone matrices, made with this pipeline's layout so only valid under it
+        GeometriesMap unskinnedLeaves;
+        if (descriptorSetLayouts.size() > BONE_MATRICES_SET)
+        {
+            for (auto& stateTransform : transformStatePair.stateTransformMap)
+            {
+                for (auto& [matrix, geometries] : stateTransform.second)
+                {
+                    for (auto& geometry : geometries)
+                    {
+                        auto skinned = bindPoseSkinnedGeometries.find(geometry.get());
+                        auto leafItr = geometriesMap.find(geometry.get());
+                        if (skinned == bindPoseSkinnedGeometries.end() || leafItr == geometriesMap.end() || unskinnedLeaves.count(geometry.get())) continue;
+
+                        auto& descriptorBuffer = skinned->second->descriptorBuffer;
+                        if (!descriptorBuffer) descriptorBuffer = vsg::DescriptorBuffer::create(skinned->second->boneMatrices, BONE_MATRICES_BINDING);
+
+                        auto descriptorSet = vsg::DescriptorSet::create(descriptorSetLayouts[BONE_MATRICES_SET], vsg::Descriptors{descriptorBuffer});
+                        auto stategroup = vsg::StateGroup::create();
+                        stategroup->add(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline->getPipelineLayout(), BONE_MATRICES_SET, descriptorSet));
+                        stategroup->addChild(leafItr->second);
+
+                        unskinnedLeaves[geometry.get()] = leafItr->second;
+                        leafItr->second = stategroup;
+                    }
+                }
+            }
+        }
+
         for (auto[stateset, transformeGeometryMap] : transformStatePair.stateTransformMap)
         {
-            vsg::ref_ptr<vsg::Node> transformGeometryGraph = createTransformGeometryGraphVSG(transformeGeometryMap, searchPaths, geometrymask);
+            vsg::ref_ptr<vsg::Node> transformGeometryGraph;
+            if (arenasPacked && buildOptions->indirectDraws) transformGeometryGraph = createIndirectGeometryGraphVSG(transformeGeometryMap);
+            if (!transformGeometryGraph) transformGeometryGraph = createTransformGeometryGraphVSG(transformeGeometryMap, searchPaths, geometrymask);
             if (!transformGeometryGraph) continue;
 
             vsg::ref_ptr<vsg::DescriptorSet> descriptorSet = createVsgStateSet(descriptorSetLayouts.front(), stateset, shaderModeMask);
@@ -914,16 +1511,71 @@ vsg::ref_ptr<vsg::Node> SceneBuilder::createVSG(vsg::Paths& searchPaths)
                 graphicsPipelineGroup->addChild(transformGeometryGraph);
             }
         }
+
+        // the arena draws are only valid under this pipeline's arena bindings so mustn't be shared with other pipelines
+        for (auto& geometry : arenaGeometries)
+        {
+            geometriesMap.erase(geometry);
+        }
+
+        for (auto& [geometry, leaf] : unskinnedLeaves)
+        {
+            geometriesMap[geometry] = leaf;
+        }
     }
 
 
     // if we are using CullGroups then place one at the top of the created scene graph
     if (buildOptions->insertCullGroups)
     {
-        vsg::ComputeBounds computeBounds;
-        group->accept(computeBounds);
+        vsg::sphere boundingSphere;
+        if (buildOptions->tightBounds)
+        {
+            boundingSphere = vsg::sphere(vsg::vec3(0.0f, 0.0f, 0.0f), -1.0f);
+            for (auto& transformStatePair : masksTransformStateMap)
+            {
+                for (auto& stateTransform : transformStatePair.second.stateTransformMap)
+                {
+                    for (auto& [matrix, geometries] : stateTransform.second)
+                    {
+                        boundingSphere = mergeBoundingSpheres(boundingSphere, computeBound(geometries, matrix));
+                    }
+                }
+            }
+        }
+        else if (buildOptions->interleaveVertexArrays || buildOptions->packArenas)
+        {
+            // vsg::ComputeBounds can't read the vertices from interleaved arrays or arenas so use the bounds of the source osg::Geometry instead
+            osg::BoundingBox overall_bb;
+            for (auto& transformStatePair : masksTransformStateMap)
+            {
+                for (auto& stateTransform : transformStatePair.second.stateTransformMap)
+                {
+                    for (auto& [matrix, geometries] : stateTransform.second)
+                    {
+                        for (auto& geometry : geometries)
+                        {
+                            osg::BoundingBox bb = geometry->getBoundingBox();
+                            for(int i=0; i<8; ++i)
+                            {
+                                overall_bb.expandBy(bb.corner(i) * matrix);
+                            }
+                        }
+                    }
+                }
+            }
+
+            vsg::vec3 bb_min(overall_bb.xMin(), overall_bb.yMin(), overall_bb.zMin());
+            vsg::vec3 bb_max(overall_bb.xMax(), overall_bb.yMax(), overall_bb.zMax());
+            boundingSphere = vsg::sphere((bb_min + bb_max)*0.5f, vsg::length(bb_max - bb_min)*0.5f);
+        }
+        else
+        {
+            vsg::ComputeBounds computeBounds;
+            group->accept(computeBounds);
 
-        vsg::sphere boundingSphere((computeBounds.bounds.min+computeBounds.bounds.max)*0.5, vsg::length(computeBounds.bounds.max-computeBounds.bounds.min)*0.5);
+            boundingSphere = vsg::sphere((computeBounds.bounds.min+computeBounds.bounds.max)*0.5, vsg::length(computeBounds.bounds.max-computeBounds.bounds.min)*0.5);
+        }
         auto cullGroup = vsg::CullGroup::create(boundingSphere);
 
         // add the groups children to the cullGroup
@@ -49,6 +49,20 @@ uint32_t osg2vsg::calculateShaderModeMask(const osg::StateSet* stateSet)
 
 // create defines string based of shader mask
 
+uint32_t osg2vsg::stripUnusedGeometryAttributes(uint32_t shaderModeMask, uint32_t geometryAttributes)
+{
+    // matches the inputs that createPSCDefineStrings() enables the shading of
+    if (!(shaderModeMask & LIGHTING)) geometryAttributes &= ~(NORMAL | NORMAL_OVERALL);
+    if (!(shaderModeMask & LIGHTING) || !(shaderModeMask & NORMAL_MAP)) geometryAttributes &= ~(TANGENT | TANGENT_OVERALL);
+    if (!(shaderModeMask & (DIFFUSE_MAP | OPACITY_MAP | AMBIENT_MAP | NORMAL_MAP | SPECULAR_MAP))) geometryAttributes &= ~TEXCOORD0;
+    if (!(shaderModeMask & SKINNING)) geometryAttributes &= ~BONES;
+
+    // only texcoord0 is passed to the shaders
+    geometryAttributes &= ~(TEXCOORD1 | TEXCOORD2);
+
+    return geometryAttributes;
+}
+
 static std::vector<std::string> createPSCDefineStrings(const uint32_t& shaderModeMask, const uint32_t& geometryAttrbutes)
 {
     bool hasnormal = geometryAttrbutes & NORMAL;
@@ -63,6 +77,7 @@ static std::vector<std::string> createPSCDefineStrings(const uint32_t& shaderMod
     if (hascolor) defines.push_back("VSG_COLOR");
     if (hastex0) defines.push_back("VSG_TEXCOORD0");
     if (hastanget) defines.push_back("VSG_TANGENT");
+    if (hasnormal && (geometryAttrbutes & QUANTIZED)) defines.push_back("VSG_OCTAHEDRAL_NORMAL");
 
     // shading modes/maps
     if (hasnormal && (shaderModeMask & LIGHTING)) defines.push_back("VSG_LIGHTING");
@@ -79,6 +94,10 @@ static std::vector<std::string> createPSCDefineStrings(const uint32_t& shaderMod
 
     if (shaderModeMask & SHADER_TRANSLATE) defines.push_back("VSG_TRANSLATE");
 
+    if (geometryAttrbutes & INSTANCE_MATRIX) defines.push_back("VSG_INSTANCE_MATRIX");
+
+    if ((shaderModeMask & SKINNING) && (geometryAttrbutes & BONES)) defines.push_back("VSG_SKINNING");
+
     return defines;
 }
 
@@ -0,0 +1,111 @@
+#include <osg2vsg/Skinning.h>
+#include <osg2vsg/GeometryUtils.h>
+
+#include <osgAnimation/BoneMapVisitor>
+#include <osgAnimation/Skeleton>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace osg2vsg;
+
+void SkinnedGeometry::update()
+{
+    if (!boneMatrices) return;
+
+    osg::Matrix skeletonToGeometry = osg::Matrix::inverse(geometryToSkeleton);
+
+    // osg::Matrixf stores its rows contiguously with the translation last, matching the column layout of vsg::mat4
+    for (size_t i = 0; i < bones.size() && i < boneMatrices->valueCount(); ++i)
+    {
+        auto& bone = bones[i];
+        osg::Matrixf matrix = bone ? geometryToSkeleton * bone->getInvBindMatrixInSkeletonSpace() * bone->getMatrixInSkeletonSpace() * skeletonToGeometry : osg::Matrix::identity();
+        std::memcpy(static_cast<void*>(&(*boneMatrices)[i]), matrix.ptr(), sizeof(vsg::mat4));
+    }
+}
+
+namespace osg2vsg
+{
+    vsg::ref_ptr<SkinnedGeometry> createSkinnedGeometry(osgAnimation::RigGeometry* rigGeometry, const osg::NodePath& nodePath)
+    {
+        osg::Geometry* source = rigGeometry->getSourceGeometry() ? rigGeometry->getSourceGeometry() : rigGeometry;
+        osgAnimation::VertexInfluenceMap* influenceMap = rigGeometry->getInfluenceMap();
+        if (!influenceMap || !source->getVertexArray()) return {};
+
+        // the skeleton is the nearest one above the geometry, the geometry's frame below it is what the bone matrices are relative to
+        auto skeletonItr = std::find_if(nodePath.rbegin(), nodePath.rend(), [](const osg::Node* node) { return dynamic_cast<const osgAnimation::Skeleton*>(node) != nullptr; });
+        if (skeletonItr == nodePath.rend()) return {};
+
+        osgAnimation::BoneMapVisitor boneMapVisitor;
+        (*skeletonItr)->accept(boneMapVisitor);
+        const osgAnimation::BoneMap& boneMap = boneMapVisitor.getBoneMap();
+
+        auto skinned = SkinnedGeometry::create();
+        skinned->rigGeometry = rigGeometry;
+        skinned->geometryToSkeleton = osg::computeLocalToWorld(osg::NodePath(skeletonItr.base(), nodePath.end()));
+        skinned->bones.push_back(nullptr);
+
+        using Influences = std::vector<std::pair<float, uint32_t>>;
+        std::vector<Influences> vertexInfluences(source->getVertexArray()->getNumElements());
+
+        for (auto& [name, influence] : *influenceMap)
+        {
+            auto boneItr = boneMap.find(name);
+            if (boneItr == boneMap.end()) continue;
+
+            uint32_t boneIndex = static_cast<uint32_t>(skinned->bones.size());
+            skinned->bones.push_back(boneItr->second);
+
+            for (auto& [vertexIndex, weight] : influence)
+            {
+                if (vertexIndex < vertexInfluences.size() && weight > 0.0f) vertexInfluences[vertexIndex].emplace_back(weight, boneIndex);
+            }
+        }
+
+        if (skinned->bones.size() > MAX_BONES) return {};
+
+        // keep the 4 heaviest influences of each vertex, renormalized so the blended matrix stays affine
+        osg::ref_ptr<osg::Vec4ubArray> boneIndices = new osg::Vec4ubArray(static_cast<unsigned int>(vertexInfluences.size()));
+        osg::ref_ptr<osg::Vec4Array> boneWeights = new osg::Vec4Array(static_cast<unsigned int>(vertexInfluences.size()));
+        for (size_t v = 0; v < vertexInfluences.size(); ++v)
+        {
+            auto& influences = vertexInfluences[v];
+            size_t count = std::min(influences.size(), size_t(4));
+            std::partial_sort(influences.begin(), influences.begin() + count, influences.end(), [](auto& lhs, auto& rhs) { return lhs.first > rhs.first; });
+
+            float sum = 0.0f;
+            for (size_t i = 0; i < count; ++i) sum += influences[i].first;
+
+            osg::Vec4ub& indices = (*boneIndices)[v];
+            osg::Vec4& weights = (*boneWeights)[v];
+            if (sum > 0.0f)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    indices[i] = static_cast<unsigned char>(influences[i].second);
+                    weights[i] = influences[i].first / sum;
+                }
+            }
+            else
+            {
+                weights[0] = 1.0f;
+            }
+        }
+
+        boneIndices->setBinding(osg::Array::BIND_PER_VERTEX);
+        boneWeights->setBinding(osg::Array::BIND_PER_VERTEX);
+
+        // the copy is drawn in place of the rig so takes on its state, but not the callbacks that deform the rig on the CPU
+        skinned->bindPoseGeometry = new osg::Geometry(*source, osg::CopyOp::SHALLOW_COPY);
+        skinned->bindPoseGeometry->setStateSet(rigGeometry->getStateSet() ? rigGeometry->getStateSet() : source->getStateSet());
+        skinned->bindPoseGeometry->setUpdateCallback(nullptr);
+        skinned->bindPoseGeometry->setComputeBoundingBoxCallback(nullptr);
+        skinned->bindPoseGeometry->setVertexAttribArray(BONE_INDICES_CHANNEL, boneIndices);
+        skinned->bindPoseGeometry->setVertexAttribArray(BONE_WEIGHTS_CHANNEL, boneWeights);
+
+        skinned->boneMatrices = vsg::mat4Array::create(MAX_BONES);
+        skinned->update();
+
+        return skinned;
+    }
+}
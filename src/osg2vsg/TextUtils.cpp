@@ -0,0 +1,242 @@
+#include <osg2vsg/TextUtils.h>
+#include <osg2vsg/ShaderUtils.h>
+
+#include <algorithm>
+
+using namespace osg2vsg;
+
+GlyphAtlas::GlyphAtlas(uint32_t in_width, uint32_t in_maxHeight) :
+    _width(in_width),
+    _maxHeight(in_maxHeight)
+{
+}
+
+bool GlyphAtlas::getPosition(osgText::Glyph* glyph, osg::Vec2& position)
+{
+    if (auto itr = _positions.find(glyph); itr != _positions.end())
+    {
+        position = itr->second;
+        return true;
+    }
+
+    if (_texture) return false;
+
+    // leave a texel of padding around each glyph so that filtering doesn't bleed between neighbours
+    uint32_t glyphWidth = glyph->s() + 1;
+    uint32_t glyphHeight = glyph->t() + 1;
+    if (glyphWidth + 1 > _width) return false;
+
+    if (_shelfX + glyphWidth + 1 > _width)
+    {
+        _shelfY += _shelfHeight;
+        _shelfX = 0;
+        _shelfHeight = 0;
+    }
+
+    if (_shelfY + glyphHeight + 1 > _maxHeight) return false;
+
+    position.set(static_cast<float>(_shelfX + 1), static_cast<float>(_shelfY + 1));
+    _positions[glyph] = position;
+
+    _shelfX += glyphWidth;
+    _shelfHeight = std::max(_shelfHeight, glyphHeight);
+
+    return true;
+}
+
+uint32_t GlyphAtlas::height() const
+{
+    uint32_t used = _shelfY + _shelfHeight + 1;
+    uint32_t height = 1;
+    while (height < used) height <<= 1;
+    return height;
+}
+
+osg::Texture2D* GlyphAtlas::getTexture()
+{
+    if (_texture) return _texture.get();
+
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(_width, height(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    // white with no coverage between the glyphs, so that filtering at their edges fades them out rather than darkening them
+    unsigned char* texel = image->data();
+    for (unsigned int i = 0; i < _width * height(); ++i, texel += 4)
+    {
+        texel[0] = texel[1] = texel[2] = 255;
+        texel[3] = 0;
+    }
+
+    // glyph images hold their coverage in alpha, whatever their pixel format
+    for (auto& [glyph, position] : _positions)
+    {
+        for (int t = 0; t < glyph->t(); ++t)
+        {
+            for (int s = 0; s < glyph->s(); ++s)
+            {
+                unsigned char* dest = image->data(static_cast<unsigned int>(position.x()) + s, static_cast<unsigned int>(position.y()) + t);
+                dest[3] = static_cast<unsigned char>(std::min(std::max(glyph->getColor(s, t).a(), 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    _texture = new osg::Texture2D(image);
+    _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    _texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _texture->setResizeNonPowerOfTwoHint(false);
+
+    return _texture.get();
+}
+
+osg::StateSet* GlyphAtlas::getStateSet()
+{
+    if (_stateset) return _stateset.get();
+
+    _stateset = new osg::StateSet;
+    _stateset->setTextureAttributeAndModes(DIFFUSE_TEXTURE_UNIT, getTexture(), osg::StateAttribute::ON);
+    _stateset->setMode(GL_BLEND, osg::StateAttribute::ON);
+    _stateset->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    _stateset->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+
+    return _stateset.get();
+}
+
+void TextBatch::add(const osgText::Text& text, const osg::Matrix& matrix, GlyphAtlas& atlas)
+{
+    // getGlyph() creates the glyphs on first use so isn't const
+    osgText::Font* font = const_cast<osgText::Font*>(text.getFont());
+    if (!font) font = osgText::Font::getDefaultFont();
+    if (!font) return;
+
+    osgText::FontResolution resolution(text.getFontWidth(), text.getFontHeight());
+
+    // glyph metrics are in units of the character height
+    float hr = text.getCharacterHeight();
+    float wr = hr / text.getCharacterAspectRatio();
+    float lineHeight = hr * (1.0f + text.getLineSpacing());
+
+    struct Quad
+    {
+        osg::Vec2 min;
+        osg::Vec2 max;
+        osg::Vec2 texel;
+        osg::Vec2 size;
+        size_t line;
+    };
+
+    std::vector<Quad> quads;
+    std::vector<float> lineWidths(1, 0.0f);
+    osg::Vec2 cursor(0.0f, 0.0f);
+    float minY = 0.0f, maxY = 0.0f;
+
+    for (auto charcode : text.getText())
+    {
+        if (charcode == '\n')
+        {
+            cursor.set(0.0f, cursor.y() - lineHeight);
+            lineWidths.push_back(0.0f);
+            continue;
+        }
+
+        osgText::Glyph* glyph = font->getGlyph(resolution, charcode);
+        if (!glyph) continue;
+
+        osg::Vec2 texel;
+        if (glyph->s() > 0 && glyph->t() > 0 && atlas.getPosition(glyph, texel))
+        {
+            osg::Vec2 bearing = glyph->getHorizontalBearing();
+            osg::Vec2 min = cursor + osg::Vec2(bearing.x() * wr, bearing.y() * hr);
+            osg::Vec2 max = min + osg::Vec2(glyph->getWidth() * wr, glyph->getHeight() * hr);
+            quads.push_back(Quad{min, max, texel, osg::Vec2(glyph->s(), glyph->t()), lineWidths.size() - 1});
+
+            if (quads.size() == 1) { minY = min.y(); maxY = max.y(); }
+            else { minY = std::min(minY, min.y()); maxY = std::max(maxY, max.y()); }
+        }
+
+        cursor.x() += glyph->getHorizontalAdvance() * wr;
+        lineWidths.back() = cursor.x();
+    }
+
+    if (quads.empty()) return;
+
+    // justify each line horizontally and the block of lines vertically
+    float justify = 0.0f;
+    float offsetY = 0.0f;
+    switch (text.getAlignment())
+    {
+        case osgText::TextBase::LEFT_TOP: offsetY = -maxY; break;
+        case osgText::TextBase::LEFT_CENTER: offsetY = -(minY + maxY) * 0.5f; break;
+        case osgText::TextBase::LEFT_BOTTOM: offsetY = -minY; break;
+        case osgText::TextBase::CENTER_TOP: justify = 0.5f; offsetY = -maxY; break;
+        case osgText::TextBase::CENTER_CENTER: justify = 0.5f; offsetY = -(minY + maxY) * 0.5f; break;
+        case osgText::TextBase::CENTER_BOTTOM: justify = 0.5f; offsetY = -minY; break;
+        case osgText::TextBase::RIGHT_TOP: justify = 1.0f; offsetY = -maxY; break;
+        case osgText::TextBase::RIGHT_CENTER: justify = 1.0f; offsetY = -(minY + maxY) * 0.5f; break;
+        case osgText::TextBase::RIGHT_BOTTOM: justify = 1.0f; offsetY = -minY; break;
+        case osgText::TextBase::LEFT_BASE_LINE: break;
+        case osgText::TextBase::CENTER_BASE_LINE: justify = 0.5f; break;
+        case osgText::TextBase::RIGHT_BASE_LINE: justify = 1.0f; break;
+        case osgText::TextBase::LEFT_BOTTOM_BASE_LINE: offsetY = lineHeight * (lineWidths.size() - 1); break;
+        case osgText::TextBase::CENTER_BOTTOM_BASE_LINE: justify = 0.5f; offsetY = lineHeight * (lineWidths.size() - 1); break;
+        case osgText::TextBase::RIGHT_BOTTOM_BASE_LINE: justify = 1.0f; offsetY = lineHeight * (lineWidths.size() - 1); break;
+    }
+
+    osg::Matrix local = osg::Matrix::rotate(text.getRotation()) * osg::Matrix::translate(text.getPosition()) * matrix;
+    osg::Vec4 color = text.getColor();
+
+    for (auto& quad : quads)
+    {
+        osg::Vec2 offset(-lineWidths[quad.line] * justify, offsetY);
+        osg::Vec2 min = quad.min + offset;
+        osg::Vec2 max = quad.max + offset;
+
+        _vertices->push_back(osg::Vec3(min.x(), min.y(), 0.0f) * local);
+        _vertices->push_back(osg::Vec3(max.x(), min.y(), 0.0f) * local);
+        _vertices->push_back(osg::Vec3(max.x(), max.y(), 0.0f) * local);
+        _vertices->push_back(osg::Vec3(min.x(), max.y(), 0.0f) * local);
+
+        _texels.push_back(quad.texel);
+        _texels.push_back(quad.texel + osg::Vec2(quad.size.x(), 0.0f));
+        _texels.push_back(quad.texel + quad.size);
+        _texels.push_back(quad.texel + osg::Vec2(0.0f, quad.size.y()));
+
+        for (int i = 0; i < 4; ++i) _colors->push_back(color);
+    }
+
+    ++_numTexts;
+}
+
+osg::ref_ptr<osg::Geometry> TextBatch::createGeometry(GlyphAtlas& atlas) const
+{
+    if (empty()) return {};
+
+    osg::ref_ptr<osg::StateSet> stateset = atlas.getStateSet();
+    osg::Vec2 scale(1.0f / static_cast<float>(atlas.width()), 1.0f / static_cast<float>(atlas.height()));
+
+    osg::ref_ptr<osg::Vec2Array> texcoords = new osg::Vec2Array;
+    texcoords->reserve(_texels.size());
+    for (auto& texel : _texels) texcoords->push_back(osg::Vec2(texel.x() * scale.x(), texel.y() * scale.y()));
+
+    osg::ref_ptr<osg::DrawElementsUInt> indices = new osg::DrawElementsUInt(GL_TRIANGLES);
+    indices->reserve(_vertices->size() / 4 * 6);
+    for (unsigned int base = 0; base < _vertices->size(); base += 4)
+    {
+        indices->push_back(base);
+        indices->push_back(base + 1);
+        indices->push_back(base + 2);
+        indices->push_back(base);
+        indices->push_back(base + 2);
+        indices->push_back(base + 3);
+    }
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+    geometry->setVertexArray(new osg::Vec3Array(*_vertices));
+    geometry->setColorArray(new osg::Vec4Array(*_colors), osg::Array::BIND_PER_VERTEX);
+    geometry->setTexCoordArray(0, texcoords);
+    geometry->addPrimitiveSet(indices);
+    geometry->setStateSet(stateset);
+
+    return geometry;
+}
@@ -1,5 +1,5 @@
 char fbxshader_vert[] = "#version 450\n"
-                        "#pragma import_defines ( VSG_NORMAL, VSG_TANGENT, VSG_COLOR, VSG_TEXCOORD0, VSG_LIGHTING, VSG_NORMAL_MAP, VSG_BILLBOARD, VSG_TRANSLATE )\n"
+                        "#pragma import_defines ( VSG_NORMAL, VSG_TANGENT, VSG_COLOR, VSG_TEXCOORD0, VSG_LIGHTING, VSG_NORMAL_MAP, VSG_BILLBOARD, VSG_TRANSLATE, VSG_OCTAHEDRAL_NORMAL, VSG_INSTANCE_MATRIX, VSG_SKINNING )\n"
                         "#extension GL_ARB_separate_shader_objects : enable\n"
                         "layout(push_constant) uniform PushConstants {\n"
                         "    mat4 projection;\n"
@@ -8,7 +8,11 @@ char fbxshader_vert[] = "#version 450\n"
                         "} pc;\n"
                         "layout(location = 0) in vec3 osg_Vertex;\n"
                         "#ifdef VSG_NORMAL\n"
+                        "#ifdef VSG_OCTAHEDRAL_NORMAL\n"
+                        "layout(location = 1) in vec2 osg_Normal;\n"
+                        "#else\n"
                         "layout(location = 1) in vec3 osg_Normal;\n"
+                        "#endif\n"
                         "layout(location = 1) out vec3 normalDir;\n"
                         "#endif\n"
                         "#ifdef VSG_TANGENT\n"
@@ -29,7 +33,30 @@ char fbxshader_vert[] = "#version 450\n"
                         "#ifdef VSG_TRANSLATE\n"
                         "layout(location = 7) in vec3 translate;\n"
                         "#endif\n"
+                        "#ifdef VSG_INSTANCE_MATRIX\n"
+                        "layout(location = 8) in mat4 instanceMatrix;\n"
+                        "#endif\n"
+                        "#ifdef VSG_SKINNING\n"
+                        "// must match osg2vsg::MAX_BONES, BONE_MATRICES_SET and BONE_MATRICES_BINDING\n"
+                        "#define MAX_BONES 128\n"
+                        "layout(location = 12) in uvec4 boneIndices;\n"
+                        "layout(location = 13) in vec4 boneWeights;\n"
+                        "layout(set = 1, binding = 0) uniform BoneMatrices {\n"
+                        "    mat4 matrices[MAX_BONES];\n"
+                        "} bones;\n"
+                        "#endif\n"
                         "\n"
+                        "#ifdef VSG_OCTAHEDRAL_NORMAL\n"
+                        "// unfold a normal packed onto the octahedron by the osg2vsg QUANTIZED conversion\n"
+                        "vec3 octahedralDecode(vec2 e)\n"
+                        "{\n"
+                        "    vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));\n"
+                        "    float t = max(-v.z, 0.0);\n"
+                        "    v.x += (v.x >= 0.0) ? -t : t;\n"
+                        "    v.y += (v.y >= 0.0) ? -t : t;\n"
+                        "    return normalize(v);\n"
+                        "}\n"
+                        "#endif\n"
                         "\n"
                         "out gl_PerVertex{ vec4 gl_Position; };\n"
                         "\n"
@@ -37,6 +64,19 @@ char fbxshader_vert[] = "#version 450\n"
                         "{\n"
                         "    mat4 modelView = pc.modelView;\n"
                         "\n"
+                        "#ifdef VSG_SKINNING\n"
+                        "    // blend the bone matrices into the model matrix so the normals and tangents are skinned along with the vertex\n"
+                        "    mat4 skinMatrix = bones.matrices[boneIndices.x] * boneWeights.x +\n"
+                        "                      bones.matrices[boneIndices.y] * boneWeights.y +\n"
+                        "                      bones.matrices[boneIndices.z] * boneWeights.z +\n"
+                        "                      bones.matrices[boneIndices.w] * boneWeights.w;\n"
+                        "    modelView = modelView * skinMatrix;\n"
+                        "#endif\n"
+                        "\n"
+                        "#ifdef VSG_INSTANCE_MATRIX\n"
+                        "    modelView = modelView * instanceMatrix;\n"
+                        "#endif\n"
+                        "\n"
                         "#ifdef VSG_TRANSLATE\n"
                         "    mat4 translate_mat = mat4(1.0, 0.0, 0.0, 0.0,\n"
                         "                              0.0, 1.0, 0.0, 0.0,\n"
@@ -72,7 +112,12 @@ char fbxshader_vert[] = "#version 450\n"
                         "    texCoord0 = osg_MultiTexCoord0.st;\n"
                         "#endif\n"
                         "#ifdef VSG_NORMAL\n"
-                        "    vec3 n = (modelView * vec4(osg_Normal, 0.0)).xyz;\n"
+                        "#ifdef VSG_OCTAHEDRAL_NORMAL\n"
+                        "    vec3 normal = octahedralDecode(osg_Normal);\n"
+                        "#else\n"
+                        "    vec3 normal = osg_Normal;\n"
+                        "#endif\n"
+                        "    vec3 n = (modelView * vec4(normal, 0.0)).xyz;\n"
                         "    normalDir = n;\n"
                         "#endif\n"
                         "#ifdef VSG_LIGHTING\n"
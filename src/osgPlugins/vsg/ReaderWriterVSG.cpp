@@ -19,6 +19,7 @@
 #include <osg2vsg/ShaderUtils.h>
 #include <osg2vsg/GeometryUtils.h>
 #include <osg2vsg/SceneBuilder.h>
+#include <osg2vsg/MeshOptimizer.h>
 
 
 class ReaderWriterVSG : public osgDB::ReaderWriter
@@ -113,14 +114,6 @@ class ReaderWriterVSG : public osgDB::ReaderWriter
                 osg_scene.accept(imv);
                 imv.makeMesh();
 
-                osgUtil::VertexCacheVisitor vcv;
-                osg_scene.accept(vcv);
-                vcv.optimizeVertices();
-
-                osgUtil::VertexAccessOrderVisitor vaov;
-                osg_scene.accept(vaov);
-                vaov.optimizeOrder();
-
                 osgUtil::Optimizer optimizer;
                 optimizer.optimize(&osg_scene, osgUtil::Optimizer::DEFAULT_OPTIMIZATIONS);
             }
@@ -134,6 +127,13 @@ class ReaderWriterVSG : public osgDB::ReaderWriter
             // build VSG scene
             vsg::ref_ptr<vsg::Node> converted_vsg_scene = sceneAnalysis.createVSG(searchPaths);
 
+            if (converted_vsg_scene && optimize)
+            {
+                osg2vsg::OptimizeMeshes optimizeMeshes;
+                converted_vsg_scene->accept(optimizeMeshes);
+                optimizeMeshes.optimize();
+            }
+
             if (converted_vsg_scene)
             {
                 return write(converted_vsg_scene, filename, options);